@@ -18,6 +18,7 @@
 
 #include <math.h>
 #include "Biquad.h"
+#include "BiquadFilter.h"
 
 Biquad::Biquad() {
 	type = bq_type_lowpass;
@@ -64,102 +65,37 @@ void Biquad::setBiquad(int type, double Fc, double Q, double peakGainDB) {
 	setPeakGain(peakGainDB);
 }
 
+// The formulas are in BiquadFilter.cpp, one function per type.
 void Biquad::calcBiquad(void) {
-	double norm;
-	double V = pow(10, fabs(peakGain) / 20.0);
-	double K = tan(M_PI * Fc);
+	BiquadCoefficients c;
 	switch (this->type) {
 	case bq_type_lowpass:
-		norm = 1 / (1 + K / Q + K * K);
-		a0 = K * K * norm;
-		a1 = 2 * a0;
-		a2 = a0;
-		b1 = 2 * (K * K - 1) * norm;
-		b2 = (1 - K / Q + K * K) * norm;
+		c = BiquadDesign<bq_type_lowpass>::calc(Fc, Q, peakGain);
 		break;
-
 	case bq_type_highpass:
-		norm = 1 / (1 + K / Q + K * K);
-		a0 = 1 * norm;
-		a1 = -2 * a0;
-		a2 = a0;
-		b1 = 2 * (K * K - 1) * norm;
-		b2 = (1 - K / Q + K * K) * norm;
+		c = BiquadDesign<bq_type_highpass>::calc(Fc, Q, peakGain);
 		break;
-
 	case bq_type_bandpass:
-		norm = 1 / (1 + K / Q + K * K);
-		a0 = K / Q * norm;
-		a1 = 0;
-		a2 = -a0;
-		b1 = 2 * (K * K - 1) * norm;
-		b2 = (1 - K / Q + K * K) * norm;
+		c = BiquadDesign<bq_type_bandpass>::calc(Fc, Q, peakGain);
 		break;
-
 	case bq_type_notch:
-		norm = 1 / (1 + K / Q + K * K);
-		a0 = (1 + K * K) * norm;
-		a1 = 2 * (K * K - 1) * norm;
-		a2 = a0;
-		b1 = a1;
-		b2 = (1 - K / Q + K * K) * norm;
+		c = BiquadDesign<bq_type_notch>::calc(Fc, Q, peakGain);
 		break;
-
 	case bq_type_peak:
-		if (peakGain >= 0) {    // boost
-			norm = 1 / (1 + 1 / Q * K + K * K);
-			a0 = (1 + V / Q * K + K * K) * norm;
-			a1 = 2 * (K * K - 1) * norm;
-			a2 = (1 - V / Q * K + K * K) * norm;
-			b1 = a1;
-			b2 = (1 - 1 / Q * K + K * K) * norm;
-		}
-		else {    // cut
-			norm = 1 / (1 + V / Q * K + K * K);
-			a0 = (1 + 1 / Q * K + K * K) * norm;
-			a1 = 2 * (K * K - 1) * norm;
-			a2 = (1 - 1 / Q * K + K * K) * norm;
-			b1 = a1;
-			b2 = (1 - V / Q * K + K * K) * norm;
-		}
+		c = BiquadDesign<bq_type_peak>::calc(Fc, Q, peakGain);
 		break;
 	case bq_type_lowshelf:
-		if (peakGain >= 0) {    // boost
-			norm = 1 / (1 + sqrt(2) * K + K * K);
-			a0 = (1 + sqrt(2 * V) * K + V * K * K) * norm;
-			a1 = 2 * (V * K * K - 1) * norm;
-			a2 = (1 - sqrt(2 * V) * K + V * K * K) * norm;
-			b1 = 2 * (K * K - 1) * norm;
-			b2 = (1 - sqrt(2) * K + K * K) * norm;
-		}
-		else {    // cut
-			norm = 1 / (1 + sqrt(2 * V) * K + V * K * K);
-			a0 = (1 + sqrt(2) * K + K * K) * norm;
-			a1 = 2 * (K * K - 1) * norm;
-			a2 = (1 - sqrt(2) * K + K * K) * norm;
-			b1 = 2 * (V * K * K - 1) * norm;
-			b2 = (1 - sqrt(2 * V) * K + V * K * K) * norm;
-		}
+		c = BiquadDesign<bq_type_lowshelf>::calc(Fc, Q, peakGain);
 		break;
 	case bq_type_highshelf:
-		if (peakGain >= 0) {    // boost
-			norm = 1 / (1 + sqrt(2) * K + K * K);
-			a0 = (V + sqrt(2 * V) * K + K * K) * norm;
-			a1 = 2 * (K * K - V) * norm;
-			a2 = (V - sqrt(2 * V) * K + K * K) * norm;
-			b1 = 2 * (K * K - 1) * norm;
-			b2 = (1 - sqrt(2) * K + K * K) * norm;
-		}
-		else {    // cut
-			norm = 1 / (V + sqrt(2 * V) * K + K * K);
-			a0 = (1 + sqrt(2) * K + K * K) * norm;
-			a1 = 2 * (K * K - 1) * norm;
-			a2 = (1 - sqrt(2) * K + K * K) * norm;
-			b1 = 2 * (K * K - V) * norm;
-			b2 = (V - sqrt(2 * V) * K + K * K) * norm;
-		}
+		c = BiquadDesign<bq_type_highshelf>::calc(Fc, Q, peakGain);
 		break;
+	default:
+		return;
 	}
-
-	return;
+	a0 = c.a0;
+	a1 = c.a1;
+	a2 = c.a2;
+	b1 = c.b1;
+	b2 = c.b2;
 }
@@ -0,0 +1,203 @@
+//
+//  BiquadBank.cpp
+//
+
+#include <math.h>
+#include "BiquadBank.h"
+#include "BiquadFilter.h"
+
+BiquadBank::BiquadBank() {
+	numBands = 0;
+	numPadded = 0;
+	sampleRate = 44100.0;
+	Q = 0.707;
+	dirty = false;
+	stage.assign(1, 0.0);
+}
+
+void BiquadBank::setBands(const double* freqs, int numBands, double Q) {
+	this->numBands = numBands;
+	this->Q = Q;
+	numPadded = (numBands + BQ_BANK_LANES - 1) / BQ_BANK_LANES * BQ_BANK_LANES;
+	freq.assign(freqs, freqs + numBands);
+	peakGain.assign(numBands, 0.0);
+	bandDirty.assign(numBands, true);
+	a0.assign(numPadded, 1.0);
+	a1.assign(numPadded, 0.0);
+	a2.assign(numPadded, 0.0);
+	b1.assign(numPadded, 0.0);
+	b2.assign(numPadded, 0.0);
+	z1.assign(numPadded, 0.0);
+	z2.assign(numPadded, 0.0);
+	stage.assign(numPadded + 1, 0.0);
+	dirty = true;
+}
+
+void BiquadBank::setThirdOctaveBands(double Q) {
+	double freqs[31];
+	for (int i = 0; i < 31; i++)
+		freqs[i] = 1000.0 * pow(2.0, (i - 17) / 3.0);
+	setBands(freqs, 31, Q);
+}
+
+void BiquadBank::setGain(int band, double peakGainDB) {
+	if (peakGainDB != peakGain[band]) {
+		peakGain[band] = peakGainDB;
+		bandDirty[band] = true;
+		dirty = true;
+	}
+}
+
+void BiquadBank::setSampleRate(double sampleRate) {
+	if (sampleRate != this->sampleRate) {
+		this->sampleRate = sampleRate;
+		bandDirty.assign(numBands, true);
+		dirty = true;
+	}
+}
+
+void BiquadBank::reset() {
+	z1.assign(numPadded, 0.0);
+	z2.assign(numPadded, 0.0);
+	stage.assign(numPadded + 1, 0.0);
+}
+
+void BiquadBank::update() {
+	for (int band = 0; band < numBands; band++) {
+		if (bandDirty[band]) {
+			calcBand(band);
+			bandDirty[band] = false;
+		}
+	}
+	dirty = false;
+}
+
+// Bands at or above Nyquist pass the signal through.
+void BiquadBank::calcBand(int band) {
+	BiquadCoefficients c = {1.0, 0.0, 0.0, 0.0, 0.0};
+	double Fc = freq[band] / sampleRate;
+	if (Fc < 0.5)
+		c = BiquadDesign<bq_type_peak>::calc(Fc, Q, peakGain[band]);
+	a0[band] = c.a0;
+	a1[band] = c.a1;
+	a2[band] = c.a2;
+	b1[band] = c.b1;
+	b2[band] = c.b2;
+}
+
+// Benchmark: the per-sample work of FixedFilterBank before (eight Biquads, all
+// recalculated on every sample) and after (eight BiquadFilters recalculated only
+// when a gain changes, in series on the same sample), against an 8-band and a
+// 31-band BiquadBank. Also checks that the cascade of BiquadFilters is the
+// cascade of Biquads sample for sample, and that the bank is the same, latency
+// aside.
+// Build with Biquad.cpp and BiquadFilter.cpp, with and without -mavx.
+#if 0
+#include <chrono>
+#include <stdio.h>
+#include "Biquad.h"
+
+int main() {
+	const int numSamples = 5000000;
+	const double freqs[8] = {75, 125, 250, 500, 1000, 2000, 4000, 8000};
+	const double gains[8] = {3, -6, 0, 2, 0, 0, 0, 0};
+	const double sampleRate = 44100.0;
+	float sink = 0.0f;
+
+	Biquad bq[8];
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < numSamples; i++) {
+		float out = ((i * 7919u) % 1000u) / 1000.0f - 0.5f;
+		for (int b = 0; b < 8; b++) {
+			bq[b].setBiquad(bq_type_peak, freqs[b] / sampleRate, 5, gains[b]);
+			out = bq[b].process(out);
+		}
+		sink += out;
+	}
+	std::chrono::duration<double> before = std::chrono::steady_clock::now() - start;
+
+	BiquadFilter<double, BiquadTDF2> cascade[8];
+	double cascadeGain[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	for (int b = 0; b < 8; b++)
+		cascade[b].design<bq_type_peak>(freqs[b] / sampleRate, 5, cascadeGain[b]);
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < numSamples; i++) {
+		float out = ((i * 7919u) % 1000u) / 1000.0f - 0.5f;
+		for (int b = 0; b < 8; b++) {
+			if (gains[b] != cascadeGain[b]) {
+				cascadeGain[b] = gains[b];
+				cascade[b].design<bq_type_peak>(freqs[b] / sampleRate, 5, cascadeGain[b]);
+			}
+		}
+		for (int b = 0; b < 8; b++)
+			out = cascade[b].process(out);
+		sink += out;
+	}
+	std::chrono::duration<double> after = std::chrono::steady_clock::now() - start;
+
+	BiquadBank bank;
+	bank.setBands(freqs, 8, 5);
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < numSamples; i++) {
+		float in = ((i * 7919u) % 1000u) / 1000.0f - 0.5f;
+		for (int b = 0; b < 8; b++)
+			bank.setGain(b, gains[b]);
+		bank.setSampleRate(sampleRate);
+		sink += bank.process(in);
+	}
+	std::chrono::duration<double> eight = std::chrono::steady_clock::now() - start;
+
+	BiquadBank thirdOctave;
+	thirdOctave.setThirdOctaveBands(4.3);
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < numSamples; i++) {
+		float in = ((i * 7919u) % 1000u) / 1000.0f - 0.5f;
+		for (int b = 0; b < 31; b++)
+			thirdOctave.setGain(b, (b % 5) - 2);
+		thirdOctave.setSampleRate(sampleRate);
+		sink += thirdOctave.process(in);
+	}
+	std::chrono::duration<double> third = std::chrono::steady_clock::now() - start;
+
+	printf("8 Biquads %.1f ns/sample, 8 BiquadFilters with dirty flags %.1f ns/sample (%.1fx)\n",
+		1e9 * before.count() / numSamples, 1e9 * after.count() / numSamples, before.count() / after.count());
+	printf("%d lanes: 8-band bank %.1f ns/sample (%d samples late), 31-band bank %.1f ns/sample (%d samples late)\n",
+		BQ_BANK_LANES, 1e9 * eight.count() / numSamples, bank.getLatency(),
+		1e9 * third.count() / numSamples, thirdOctave.getLatency());
+
+	// The cascade as FixedFilterBank runs it against the Biquads it replaced, and the
+	// bank against both, numBands - 1 samples later
+	Biquad reference[8];
+	BiquadFilter<double, BiquadTDF2> filters[8];
+	for (int b = 0; b < 8; b++) {
+		reference[b].setBiquad(bq_type_peak, freqs[b] / sampleRate, 5, gains[b]);
+		filters[b].design<bq_type_peak>(freqs[b] / sampleRate, 5, gains[b]);
+	}
+	BiquadBank check;
+	check.setBands(freqs, 8, 5);
+	for (int b = 0; b < 8; b++)
+		check.setGain(b, gains[b]);
+	check.setSampleRate(sampleRate);
+	std::vector<float> expected;
+	int cascadeMismatches = 0;
+	double maxError = 0.0;
+	for (int i = 0; i < 100000; i++) {
+		float in = sinf(0.001f * i * (1 + i % 7));
+		float out = in, filtersOut = in;
+		for (int b = 0; b < 8; b++) {
+			out = reference[b].process(out);
+			filtersOut = filters[b].process(filtersOut);
+		}
+		expected.push_back(out);
+		cascadeMismatches += filtersOut != out;
+		float bankOut = check.process(in);
+		if (i >= check.getLatency())
+			maxError = fmax(maxError, fabs(bankOut - expected[i - check.getLatency()]));
+	}
+	printf("cascade of BiquadFilters: %d samples differ from the cascade of Biquads\n", cascadeMismatches);
+	printf("bank: largest difference to the cascade of Biquads, %d samples earlier: %g\n",
+		check.getLatency(), maxError);
+	printf("(%g)\n", sink);
+	return 0;
+}
+#endif
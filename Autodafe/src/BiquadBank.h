@@ -0,0 +1,100 @@
+//
+//  BiquadBank.h
+//
+//  A cascade of peaking EQ bands, for graphic equalizers with many bands, like
+//  the 31 third-octave bands. The coefficients are those of Biquad with
+//  bq_type_peak, from BiquadDesign. They are recalculated only for the bands
+//  whose gain changed, or for all of them when the sample rate changes, instead
+//  of on every sample.
+//
+//  The bands are stored as structure of arrays and processed together with
+//  SIMD, 4 bands per operation with AVX and 2 with SSE2 (in double, like the
+//  state of Biquad). A cascade cannot run all its stages on the same sample,
+//  so the bank is pipelined: on every sample, band k filters the output band
+//  k - 1 produced on the previous sample. The frequency response is that of
+//  the plain cascade, but the output comes getLatency() = numBands - 1 samples
+//  later, which a module using the bank must state. The cost grows with
+//  numBands / lanes, so 31 bands stay cheap.
+//
+//  For a few bands the latency is not worth it: FixedFilterBank runs its eight
+//  bands as a cascade of BiquadFilter, with the same dirty flags, and no
+//  latency.
+//
+
+#ifndef BiquadBank_h
+#define BiquadBank_h
+
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define BQ_BANK_LANES 4
+typedef __m256d BiquadBankVector;
+inline BiquadBankVector bqBankLoad(const double* p) { return _mm256_loadu_pd(p); }
+inline void bqBankStore(double* p, BiquadBankVector v) { _mm256_storeu_pd(p, v); }
+inline BiquadBankVector bqBankAdd(BiquadBankVector a, BiquadBankVector b) { return _mm256_add_pd(a, b); }
+inline BiquadBankVector bqBankSub(BiquadBankVector a, BiquadBankVector b) { return _mm256_sub_pd(a, b); }
+inline BiquadBankVector bqBankMul(BiquadBankVector a, BiquadBankVector b) { return _mm256_mul_pd(a, b); }
+#else
+#include <emmintrin.h>
+#define BQ_BANK_LANES 2
+typedef __m128d BiquadBankVector;
+inline BiquadBankVector bqBankLoad(const double* p) { return _mm_loadu_pd(p); }
+inline void bqBankStore(double* p, BiquadBankVector v) { _mm_storeu_pd(p, v); }
+inline BiquadBankVector bqBankAdd(BiquadBankVector a, BiquadBankVector b) { return _mm_add_pd(a, b); }
+inline BiquadBankVector bqBankSub(BiquadBankVector a, BiquadBankVector b) { return _mm_sub_pd(a, b); }
+inline BiquadBankVector bqBankMul(BiquadBankVector a, BiquadBankVector b) { return _mm_mul_pd(a, b); }
+#endif
+
+class BiquadBank {
+public:
+	BiquadBank();
+	// Replaces the bands with numBands peaking bands at the given centre frequencies (Hz),
+	// all with the same Q, at 0 dB.
+	void setBands(const double* freqs, int numBands, double Q);
+	// The 31 ISO third-octave bands from 20 Hz to 20 kHz (exact base 2 centres around 1 kHz).
+	void setThirdOctaveBands(double Q);
+	// Only marks the bands for recalculation when the value changed, so both can be
+	// called on every sample with the current knob values.
+	void setGain(int band, double peakGainDB);
+	void setSampleRate(double sampleRate);
+	int getNumBands() const { return numBands; }
+	int getLatency() const { return numBands > 0 ? numBands - 1 : 0; }
+	void reset();
+	float process(float in);
+
+protected:
+	void calcBand(int band);
+	void update();
+
+	int numBands;
+	int numPadded; // numBands rounded up to a multiple of BQ_BANK_LANES
+	double sampleRate;
+	double Q;
+	bool dirty; // some band needs new coefficients
+	std::vector<double> freq, peakGain;
+	std::vector<bool> bandDirty;
+	// Structure of arrays, one entry per band, padded with pass-through bands
+	std::vector<double> a0, a1, a2, b1, b2;
+	std::vector<double> z1, z2;
+	// stage[k] is the input of band k on this sample, stage[k + 1] its output
+	std::vector<double> stage;
+};
+
+inline float BiquadBank::process(float in) {
+	if (dirty)
+		update();
+	stage[0] = in;
+	// Highest bands first, so that each block reads its inputs before the block
+	// below writes its outputs over them.
+	for (int k = numPadded - BQ_BANK_LANES; k >= 0; k -= BQ_BANK_LANES) {
+		BiquadBankVector x = bqBankLoad(&stage[k]);
+		BiquadBankVector out = bqBankAdd(bqBankMul(x, bqBankLoad(&a0[k])), bqBankLoad(&z1[k]));
+		bqBankStore(&z1[k], bqBankSub(bqBankAdd(bqBankMul(x, bqBankLoad(&a1[k])), bqBankLoad(&z2[k])), bqBankMul(bqBankLoad(&b1[k]), out)));
+		bqBankStore(&z2[k], bqBankSub(bqBankMul(x, bqBankLoad(&a2[k])), bqBankMul(bqBankLoad(&b2[k]), out)));
+		bqBankStore(&stage[k + 1], out);
+	}
+	return stage[numBands];
+}
+
+#endif // BiquadBank_h
@@ -0,0 +1,210 @@
+//
+//  BiquadFilter.cpp
+//
+//  The coefficient formulas of Biquad::calcBiquad(), one function per type.
+//
+
+#include <math.h>
+#include "BiquadFilter.h"
+
+BiquadCoefficients BiquadDesign<bq_type_lowpass>::calc(double Fc, double Q, double peakGainDB) {
+	BiquadCoefficients c;
+	double norm;
+	double K = tan(M_PI * Fc);
+	norm = 1 / (1 + K / Q + K * K);
+	c.a0 = K * K * norm;
+	c.a1 = 2 * c.a0;
+	c.a2 = c.a0;
+	c.b1 = 2 * (K * K - 1) * norm;
+	c.b2 = (1 - K / Q + K * K) * norm;
+	return c;
+}
+
+BiquadCoefficients BiquadDesign<bq_type_highpass>::calc(double Fc, double Q, double peakGainDB) {
+	BiquadCoefficients c;
+	double norm;
+	double K = tan(M_PI * Fc);
+	norm = 1 / (1 + K / Q + K * K);
+	c.a0 = 1 * norm;
+	c.a1 = -2 * c.a0;
+	c.a2 = c.a0;
+	c.b1 = 2 * (K * K - 1) * norm;
+	c.b2 = (1 - K / Q + K * K) * norm;
+	return c;
+}
+
+BiquadCoefficients BiquadDesign<bq_type_bandpass>::calc(double Fc, double Q, double peakGainDB) {
+	BiquadCoefficients c;
+	double norm;
+	double K = tan(M_PI * Fc);
+	norm = 1 / (1 + K / Q + K * K);
+	c.a0 = K / Q * norm;
+	c.a1 = 0;
+	c.a2 = -c.a0;
+	c.b1 = 2 * (K * K - 1) * norm;
+	c.b2 = (1 - K / Q + K * K) * norm;
+	return c;
+}
+
+BiquadCoefficients BiquadDesign<bq_type_notch>::calc(double Fc, double Q, double peakGainDB) {
+	BiquadCoefficients c;
+	double norm;
+	double K = tan(M_PI * Fc);
+	norm = 1 / (1 + K / Q + K * K);
+	c.a0 = (1 + K * K) * norm;
+	c.a1 = 2 * (K * K - 1) * norm;
+	c.a2 = c.a0;
+	c.b1 = c.a1;
+	c.b2 = (1 - K / Q + K * K) * norm;
+	return c;
+}
+
+BiquadCoefficients BiquadDesign<bq_type_peak>::calc(double Fc, double Q, double peakGainDB) {
+	BiquadCoefficients c;
+	double norm;
+	double V = pow(10, fabs(peakGainDB) / 20.0);
+	double K = tan(M_PI * Fc);
+	if (peakGainDB >= 0) {    // boost
+		norm = 1 / (1 + 1 / Q * K + K * K);
+		c.a0 = (1 + V / Q * K + K * K) * norm;
+		c.a1 = 2 * (K * K - 1) * norm;
+		c.a2 = (1 - V / Q * K + K * K) * norm;
+		c.b1 = c.a1;
+		c.b2 = (1 - 1 / Q * K + K * K) * norm;
+	}
+	else {    // cut
+		norm = 1 / (1 + V / Q * K + K * K);
+		c.a0 = (1 + 1 / Q * K + K * K) * norm;
+		c.a1 = 2 * (K * K - 1) * norm;
+		c.a2 = (1 - 1 / Q * K + K * K) * norm;
+		c.b1 = c.a1;
+		c.b2 = (1 - V / Q * K + K * K) * norm;
+	}
+	return c;
+}
+
+BiquadCoefficients BiquadDesign<bq_type_lowshelf>::calc(double Fc, double Q, double peakGainDB) {
+	BiquadCoefficients c;
+	double norm;
+	double V = pow(10, fabs(peakGainDB) / 20.0);
+	double K = tan(M_PI * Fc);
+	if (peakGainDB >= 0) {    // boost
+		norm = 1 / (1 + sqrt(2) * K + K * K);
+		c.a0 = (1 + sqrt(2 * V) * K + V * K * K) * norm;
+		c.a1 = 2 * (V * K * K - 1) * norm;
+		c.a2 = (1 - sqrt(2 * V) * K + V * K * K) * norm;
+		c.b1 = 2 * (K * K - 1) * norm;
+		c.b2 = (1 - sqrt(2) * K + K * K) * norm;
+	}
+	else {    // cut
+		norm = 1 / (1 + sqrt(2 * V) * K + V * K * K);
+		c.a0 = (1 + sqrt(2) * K + K * K) * norm;
+		c.a1 = 2 * (K * K - 1) * norm;
+		c.a2 = (1 - sqrt(2) * K + K * K) * norm;
+		c.b1 = 2 * (V * K * K - 1) * norm;
+		c.b2 = (1 - sqrt(2 * V) * K + V * K * K) * norm;
+	}
+	return c;
+}
+
+BiquadCoefficients BiquadDesign<bq_type_highshelf>::calc(double Fc, double Q, double peakGainDB) {
+	BiquadCoefficients c;
+	double norm;
+	double V = pow(10, fabs(peakGainDB) / 20.0);
+	double K = tan(M_PI * Fc);
+	if (peakGainDB >= 0) {    // boost
+		norm = 1 / (1 + sqrt(2) * K + K * K);
+		c.a0 = (V + sqrt(2 * V) * K + K * K) * norm;
+		c.a1 = 2 * (K * K - V) * norm;
+		c.a2 = (V - sqrt(2 * V) * K + K * K) * norm;
+		c.b1 = 2 * (K * K - 1) * norm;
+		c.b2 = (1 - sqrt(2) * K + K * K) * norm;
+	}
+	else {    // cut
+		norm = 1 / (V + sqrt(2 * V) * K + K * K);
+		c.a0 = (1 + sqrt(2) * K + K * K) * norm;
+		c.a1 = 2 * (K * K - 1) * norm;
+		c.a2 = (1 - sqrt(2) * K + K * K) * norm;
+		c.b1 = 2 * (K * K - V) * norm;
+		c.b2 = (V - sqrt(2 * V) * K + K * K) * norm;
+	}
+	return c;
+}
+
+// Benchmark and error analysis: the per-sample and block paths against Biquad,
+// and the error of each sample type and topology for low-frequency bands
+// against a long double reference with the same design. Build with Biquad.cpp.
+#if 0
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+// Error power relative to the output power, in dB, for a +12 dB peak at Q 5 on white noise
+template <typename Sample, int Topology>
+double errorDB(double Fc, const std::vector<float> &noise) {
+	BiquadCoefficients c = BiquadDesign<bq_type_peak>::calc(Fc, 5, 12);
+	BiquadFilter<Sample, Topology> filter;
+	filter.setCoefficients(c);
+	long double z1 = 0, z2 = 0;
+	double error = 0.0, power = 0.0;
+	for (size_t i = 0; i < noise.size(); i++) {
+		long double x = noise[i];
+		long double exact = x * c.a0 + z1;
+		z1 = x * c.a1 + z2 - c.b1 * exact;
+		z2 = x * c.a2 - c.b2 * exact;
+		double difference = (double) (filter.process(noise[i]) - exact);
+		error += difference * difference;
+		power += (double) (exact * exact);
+	}
+	return 10 * log10(error / power);
+}
+
+int main() {
+	const int numSamples = 10000000;
+	std::vector<float> noise(numSamples), out(numSamples);
+	unsigned int seed = 1;
+	for (int i = 0; i < numSamples; i++) {
+		seed = seed * 1664525u + 1013904223u;
+		noise[i] = (seed >> 8) / 16777216.0f - 0.5f;
+	}
+
+	Biquad biquad;
+	biquad.setBiquad(bq_type_peak, 1000.0 / 44100.0, 5, 6);
+	BiquadFilter<double, BiquadTDF2> same;
+	same.design<bq_type_peak>(1000.0 / 44100.0, 5, 6);
+	BiquadFilter<float, BiquadTDF2> block;
+	block.design<bq_type_peak>(1000.0 / 44100.0, 5, 6);
+	int differences = 0;
+	float sink = 0.0f;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < numSamples; i++)
+		out[i] = biquad.process(noise[i]);
+	std::chrono::duration<double> perSample = std::chrono::steady_clock::now() - start;
+	for (int i = 0; i < numSamples; i++)
+		differences += (same.process(noise[i]) != out[i]);
+	same.reset();
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < numSamples; i += 256)
+		same.process(&noise[i], &out[i], 256);
+	std::chrono::duration<double> blockDouble = std::chrono::steady_clock::now() - start;
+	sink += out[numSamples - 1];
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < numSamples; i += 256)
+		block.process(&noise[i], &out[i], 256);
+	std::chrono::duration<double> blockFloat = std::chrono::steady_clock::now() - start;
+	sink += out[numSamples - 1];
+	printf("Biquad %.2f ns/sample, block double TDF2 %.2f ns/sample, block float TDF2 %.2f ns/sample\n",
+		1e9 * perSample.count() / numSamples, 1e9 * blockDouble.count() / numSamples, 1e9 * blockFloat.count() / numSamples);
+	printf("samples where BiquadFilter<double, BiquadTDF2> differs from Biquad: %d\n", differences);
+
+	const double bands[][2] = {{20, 192000}, {20, 48000}, {75, 44100}, {1000, 48000}};
+	for (const auto &band : bands) {
+		double Fc = band[0] / band[1];
+		printf("%5.0f Hz at %6.0f Hz: float DF1 %.0f dB, float TDF2 %.0f dB, double DF1 %.0f dB, double TDF2 %.0f dB\n",
+			band[0], band[1], errorDB<float, BiquadDF1>(Fc, noise), errorDB<float, BiquadTDF2>(Fc, noise),
+			errorDB<double, BiquadDF1>(Fc, noise), errorDB<double, BiquadTDF2>(Fc, noise));
+	}
+	printf("(%g)\n", sink);
+	return 0;
+}
+#endif
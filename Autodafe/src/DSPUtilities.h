@@ -7,6 +7,8 @@
 #ifndef DSPUtilities_h
 #define DSPUtilities_h
 
+#include <stdint.h>
+
 
 //==============================================================================
 
@@ -79,5 +81,52 @@ double resonanceToQ(double resonance);
 
 //==============================================================================
 
+/**
+ Fast tan(pi * x), for prewarping the cutoff of bilinear-transform filters
+ (x = cutoff / sampleRate) on every sample. A rational approximation on
+ 0 <= x <= 1/4, reflected with tan(pi/2 - a) = 1 / tan(a) above, so that it
+ stays accurate right up to Nyquist: relative error below 3e-7 for
+ 0 < x < 0.5, about the rounding error of tanf() itself. One division, no table.
+ */
+inline float fastTanPi(float x)
+{
+    const bool reflect = x > 0.25f;
+    const float a = 3.14159265f * (reflect ? 0.5f - x : x);
+    const float a2 = a * a;
+    const float num = a * (945.0f + a2 * (a2 - 105.0f));
+    const float den = 945.0f + a2 * (15.0f * a2 - 420.0f);
+    return reflect ? den / num : num / den;
+}
+
+//==============================================================================
+
+/**
+ Fast 2^x, for exponential cutoff modulation. A 5th order polynomial of the
+ fractional part, scaled by the integer part through the exponent bits.
+ Relative error below 2e-7 for -126 <= x < 128.
+ */
+inline float fastExp2(float x)
+{
+    int i = static_cast<int>(x);
+    if (x < i)
+        i--;		// floor
+    const float f = x - i;
+    const float p = 9.999999269e-01f + f * (6.931529682e-01f + f * (2.401545299e-01f
+                  + f * (5.582360446e-02f + f * (8.992584031e-03f + f * 1.876232945e-03f))));
+    union { float f; int32_t i; } scale;
+    scale.i = (i + 127) << 23;
+    return p * scale.f;
+}
+
+//==============================================================================
+
+// Fast pitchToFreq(), relative error below 1e-6 for pitches from -20 to 140.
+inline float fastPitchToFreq(float pitch)
+{
+    return 440.0f * fastExp2((pitch - 69.0f) * (1.0f / 12.0f));
+}
+
+//==============================================================================
+
 
 #endif /* DSPUtilities_h */
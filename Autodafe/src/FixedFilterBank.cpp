@@ -8,6 +8,7 @@
 //**************************************************************************************
 
 #include "Autodafe.hpp"
+#include "BiquadFilter.h"
 #include <stdlib.h>
 
 
@@ -39,14 +40,11 @@ struct FixedFilter : Module{
 
 	FixedFilter();
 
-Biquad *bq1 = new Biquad();
-Biquad *bq2 = new Biquad();
-Biquad *bq3 = new Biquad();
-Biquad *bq4 = new Biquad();
-Biquad *bq5 = new Biquad();
-Biquad *bq6 = new Biquad();
-Biquad *bq7 = new Biquad();
-Biquad *bq8 = new Biquad();
+	// EQ1 to EQ8, in series. A band's coefficients are only recalculated when
+	// its knob moved or the sample rate changed.
+	BiquadFilter<double, BiquadTDF2> bq[8];
+	float gain[8];
+	float sampleRate;
 
 	
 	void step();
@@ -64,9 +62,11 @@ FixedFilter::FixedFilter() {
 	params.resize(NUM_PARAMS);
 	inputs.resize(NUM_INPUTS);
 	outputs.resize(NUM_OUTPUTS);
-}
 
-float out;
+	for (int i = 0; i < 8; i++)
+		gain[i] = 0.0;
+	sampleRate = 0.0; // designs every band on the first step
+}
 
 
 
@@ -83,26 +83,20 @@ void FixedFilter::step() {
 	
 
 
-	bq1->setBiquad(bq_type_peak, 75.0 / engineGetSampleRate(), 5, params[EQ1].value);
-	bq2->setBiquad(bq_type_peak, 125.0 / engineGetSampleRate(), 5, params[EQ2].value);
-	bq3->setBiquad(bq_type_peak, 250.0 / engineGetSampleRate(), 5, params[EQ3].value);
-	bq4->setBiquad(bq_type_peak, 500.0 / engineGetSampleRate(), 5, params[EQ4].value);
-	bq5->setBiquad(bq_type_peak, 1000.0 / engineGetSampleRate(), 5, params[EQ5].value);
-	bq6->setBiquad(bq_type_peak, 2000.0 / engineGetSampleRate(), 5, params[EQ6].value);
-	bq7->setBiquad(bq_type_peak, 4000.0 / engineGetSampleRate(), 5, params[EQ7].value);
-	bq8->setBiquad(bq_type_peak, 8000.0 / engineGetSampleRate(), 5, params[EQ8].value);
+	const double freqs[8] = {75.0, 125.0, 250.0, 500.0, 1000.0, 2000.0, 4000.0, 8000.0};
+	bool rateChanged = engineGetSampleRate() != sampleRate;
+	sampleRate = engineGetSampleRate();
+	for (int i = 0; i < 8; i++) {
+		if (rateChanged || params[EQ1 + i].value != gain[i]) {
+			gain[i] = params[EQ1 + i].value;
+			bq[i].design<bq_type_peak>(freqs[i] / sampleRate, 5, gain[i]);
+		}
+	}
 
-	
-	
-	
-	out = bq1->process(input);
-	out = bq2->process(out);
-	out = bq3->process(out);
-	out = bq4->process(out);
-	out = bq5->process(out);
-	out = bq6->process(out);
-	out = bq7->process(out);
-	out = bq8->process(out);
+	// All eight bands on the same sample, so the EQ adds no latency
+	float out = input;
+	for (int i = 0; i < 8; i++)
+		out = bq[i].process(out);
 
 
 
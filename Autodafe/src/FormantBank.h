@@ -0,0 +1,114 @@
+//
+//  FormantBank.h
+//
+//  A formant filter made of second-order sections: one two-pole resonator per
+//  formant, in cascade, which together are the all-pole filter of a vowel.
+//  The vowels are given as formant frequencies and bandwidths in Hz, so they
+//  sit at the same frequencies at any sample rate. The vowel position is
+//  continuous. generateFormantTable() designs the sections at a number of
+//  steps between each two vowels, interpolating the frequency, bandwidth and
+//  level, and the bank interpolates the coefficients between the two nearest
+//  steps. So a morph moves the poles of each formant instead of mixing the
+//  coefficients of two high-order polynomials, which can be unstable, and the
+//  trig runs only when the vowels, the resolution or the sample rate change.
+//
+//  The formants of the default vowels are the poles of the 10th-order filters
+//  of the original FormantFilter (alex@smartelectronix.com, musicdsp.org) at
+//  44.1 kHz, so the vowels themselves sound as before.
+//
+//  Each resonator keeps two state values, updated in place; there is no delay
+//  line to shift. The sections run in order on every sample, so the filter
+//  adds no latency.
+//
+
+#ifndef FormantBank_h
+#define FormantBank_h
+
+#include <vector>
+
+#define FORMANT_SECTIONS 5
+#define FORMANT_MAX_VOWELS 16
+
+struct Formant {
+	double freq;		// Hz
+	double bandwidth;	// Hz
+};
+
+struct VowelFormants {
+	double level;		// gain at DC
+	Formant formants[FORMANT_SECTIONS];
+};
+
+// A, E, I, O, U of the original FormantFilter
+extern const VowelFormants formantVowelsAEIOU[5];
+
+// The sections for one morph position. The feedback coefficients are stored
+// negated: fb1 = -b1, fb2 = -b2.
+struct FormantSections {
+	double fb1[FORMANT_SECTIONS], fb2[FORMANT_SECTIONS];
+	double level;
+};
+
+// Fills table with the sections at every 1 / resolution of the morph position,
+// (numVowels - 1) * resolution + 1 entries, for the given sample rate.
+void generateFormantTable(const VowelFormants* vowels, int numVowels, int resolution,
+	double sampleRate, std::vector<FormantSections> &table);
+
+class FormantBank {
+public:
+	FormantBank();
+	// Copies up to FORMANT_MAX_VOWELS vowels, in morph order.
+	void setVowels(const VowelFormants* vowels, int numVowels);
+	// Like setVowels(), for vowels prepared on another thread: table is made by
+	// generateFormantTable() for these vowels at getResolution() and
+	// tableSampleRate, and is swapped with the bank's, so nothing is allocated
+	// unless the sample rate changed meanwhile.
+	void swapVowels(const VowelFormants* vowels, int numVowels,
+		std::vector<FormantSections> &table, double tableSampleRate);
+	int getNumVowels() const { return numVowels; }
+	const VowelFormants &getVowel(int i) const { return vowels[i]; }
+	// Table steps between two vowels, 16 by default.
+	void setResolution(int resolution);
+	int getResolution() const { return resolution; }
+	// 0 is the first vowel, numVowels - 1 the last, and values in between morph
+	// between neighbours. Only interpolates the table, when the position changed,
+	// so it can be called on every sample.
+	void setMorph(float position);
+	// Generates the table again. Call it when the sample rate changes, not on
+	// every sample.
+	void setSampleRate(double sampleRate);
+	void reset();
+	float process(float in);
+
+protected:
+	void update();
+
+	VowelFormants vowels[FORMANT_MAX_VOWELS];
+	int numVowels;
+	int resolution;
+	float morph;
+	double sampleRate;
+	bool dirty; // the sections need new coefficients
+	double gain;
+	std::vector<FormantSections> table;
+	// One entry per section. The feedback coefficients are stored negated:
+	// fb1 = -b1, fb2 = -b2.
+	double fb1[FORMANT_SECTIONS], fb2[FORMANT_SECTIONS];
+	double z1[FORMANT_SECTIONS], z2[FORMANT_SECTIONS];
+};
+
+// Each section is an all-pole biquad, transposed direct form II.
+inline float FormantBank::process(float in) {
+	if (dirty)
+		update();
+	double x = in * gain;
+	for (int k = 0; k < FORMANT_SECTIONS; k++) {
+		double out = x + z1[k];
+		z1[k] = z2[k] + fb1[k] * out;
+		z2[k] = fb2[k] * out;
+		x = out;
+	}
+	return x;
+}
+
+#endif // FormantBank_h
@@ -6,159 +6,13 @@
 //**************************************************************************************
 
 #include "Autodafe.hpp"
+#include "FormantBank.h"
+#include <atomic>
+#include <cmath>
+#include <mutex>
 
 
 
-
-double CosineInterpolate(
-   double y1,double y2,
-   double mu)
-{
-   double mu2;
-
-   mu2 = (1-cos(mu*M_PI))/2;
-   return(y1*(1-mu2)+y2*mu2);
-}
-
-/*
-Public source code by alex@smartelectronix.com
-Simple example of implementation of formant filter
-Vowelnum can be 0,1,2,3,4 <=> A,E,I,O,U
-Good for spectral rich input like saw or square
-*/
-//-------------------------------------------------------------VOWEL COEFFICIENTS
-const double coeff[9][11] = {
-	{ 3.11044e-06,
-	8.943665402, -36.83889529, 92.01697887, -154.337906, 181.6233289,
-	-151.8651235, 89.09614114, -35.10298511, 8.388101016, -0.923313471  ///A
-	},
-
-
-
-
-{
-	CosineInterpolate(3.11044e-06, 4.36215e-06,0.5), 
-CosineInterpolate(8.943665402, 8.90438318,0.5),
-CosineInterpolate(-36.83889529, -36.55179099,0.5),
-CosineInterpolate(92.01697887, 91.05750846,0.5),
-CosineInterpolate(-154.337906, -152.422234,0.5),
-CosineInterpolate(181.6233289, 179.1170248,0.5),
-CosineInterpolate(-151.8651235, -149.6496211,0.5),
-CosineInterpolate(89.09614114, 87.78352223,0.5),
-CosineInterpolate(-35.10298511, -34.60687431,0.5),
-CosineInterpolate(8.388101016, 8.282228154,0.5),
-CosineInterpolate(-0.923313471, -0.914150747,0.5)
-},
-
-	{ 4.36215e-06,
-	8.90438318, -36.55179099, 91.05750846, -152.422234, 179.1170248,  ///E
-	-149.6496211, 87.78352223, -34.60687431, 8.282228154, -0.914150747
-	},
-
-{
-	CosineInterpolate(4.36215e-06, 3.33819e-06,0.5), 
-	CosineInterpolate(8.90438318, 8.893102966,0.5), 
-	CosineInterpolate(-36.55179099, -36.49532826,0.5), 
-	CosineInterpolate(91.05750846, 90.96543286,0.5), 
-	CosineInterpolate(-152.422234, -152.4545478,0.5), 
-	CosineInterpolate(179.1170248, 179.4835618,0.5), 
-	CosineInterpolate(-149.6496211, -150.315433,0.5), 
-	CosineInterpolate(87.78352223, 88.43409371,0.5), 
-	CosineInterpolate(-34.60687431, -34.98612086,0.5), 
-	CosineInterpolate(8.282228154, 8.407803364,0.5), 
-	CosineInterpolate(-0.914150747, -0.932568035,0.5)
-},
-
-	{ 3.33819e-06,
-	8.893102966, -36.49532826, 90.96543286, -152.4545478, 179.4835618,
-	-150.315433, 88.43409371, -34.98612086, 8.407803364, -0.932568035  ///I
-	},
-
-
-{
-	CosineInterpolate(3.33819e-06 , 1.13572e-06,0.5), 
-	CosineInterpolate(8.893102966 , 8.994734087,0.5), 
-	CosineInterpolate(-36.49532826 , -37.2084849,0.5), 
-	CosineInterpolate(90.96543286 , 93.22900521,0.5), 
-	CosineInterpolate(-152.4545478 , -156.6929844,0.5), 
-	CosineInterpolate(179.4835618 , 184.596544,0.5), 
-	CosineInterpolate(-150.315433 , -154.3755513,0.5), 
-	CosineInterpolate(88.43409371 , 90.49663749,0.5), 
-	CosineInterpolate(-34.98612086 , -35.58964535,0.5), 
-	CosineInterpolate(8.407803364 , 8.478996281,0.5), 
-	CosineInterpolate(-0.932568035 , -0.929252233,0.5), 
-
-},
-
-	{ 1.13572e-06,
-	8.994734087, -37.2084849, 93.22900521, -156.6929844, 184.596544,   ///O
-	-154.3755513, 90.49663749, -35.58964535, 8.478996281, -0.929252233
-	},
-
-
-{
-	CosineInterpolate(1.13572e-06 , 4.09431e-07,0.5), 
-CosineInterpolate(8.994734087 , 8.997322763,0.5), 
-CosineInterpolate(-37.2084849 , -37.20218544,0.5), 
-CosineInterpolate(93.22900521 , 93.11385476,0.5), 
-CosineInterpolate(-156.6929844 , -156.2530937,0.5), 
-CosineInterpolate(184.596544 , 183.7080141,0.5), 
-CosineInterpolate(-154.3755513 , -153.2631681,0.5), 
-CosineInterpolate(90.49663749 , 89.59539726,0.5), 
-CosineInterpolate(-35.58964535 , -35.12454591,0.5), 
-CosineInterpolate(8.478996281 , 8.338655623,0.5), 
-CosineInterpolate(-0.929252233 , -0.910251753,0.5), 
-
-
-},
-
-
-
-	{ 4.09431e-07,
-	8.997322763, -37.20218544, 93.11385476, -156.2530937, 183.7080141,  ///U
-	-153.2631681, 89.59539726, -35.12454591, 8.338655623, -0.910251753
-	}
-};
-//---------------------------------------------------------------------------------
-
-//---------------------------------------------------------------------------------
-
- 
-struct FFilter {
-
- double memory[10] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-
-	
-float formant_filter(float in, int vowelnum, float tone)
-{
-	float res = (float)(coeff[vowelnum][0] * in/2 +
-		coeff[vowelnum][1] * memory[0] +
-		coeff[vowelnum][2] * memory[1] +
-		coeff[vowelnum][3] * memory[2] +
-		coeff[vowelnum][4] * memory[3] +
-		coeff[vowelnum][5] * memory[4] +
-		coeff[vowelnum][6] * memory[5] +
-		coeff[vowelnum][7] * memory[6] +
-		coeff[vowelnum][8] * memory[7] +
-		coeff[vowelnum][9] * memory[8] +
-		coeff[vowelnum][10] * memory[9]);
-
-	memory[9] = memory[8];
-	memory[8] = memory[7];
-	memory[7] = memory[6];
-	memory[6] = memory[5];
-	memory[5] = memory[4];
-	memory[4] = memory[3];
-	memory[3] = memory[2];
-	memory[2] = memory[1];
-	memory[1] = memory[0];
-	memory[0] = (double)res;
-	return res;
-}
-
-};
-
-
 struct FormantFilter : Module {
 	enum ParamIds {
 		VOWEL_PARAM,
@@ -178,10 +32,95 @@ struct FormantFilter : Module {
 
 	FormantFilter();
 
-	FFilter *ffilter = new FFilter();
+	// A, E, I, O, U by default, or the vowels saved in the patch
+	FormantBank bank;
+
+	// The vowel set of the patch, for toJson() and fromJson() on the UI thread.
+	// fromJson() also makes its table, and step() swaps both into the bank when
+	// it gets the lock without waiting, so the engine thread never reads a table
+	// while it is rebuilt.
+	std::mutex vowelsMutex;
+	VowelFormants vowels[FORMANT_MAX_VOWELS];
+	int numVowels;
+	std::vector<FormantSections> pendingTable;
+	double pendingSampleRate;
+	std::atomic_bool vowelsPending;
 
 
 	void step();
+
+	void onSampleRateChange() override {
+		bank.setSampleRate(engineGetSampleRate());
+	}
+
+	// The vowel set, which can be replaced by editing the patch:
+	// "vowels": [{"level": 0.5, "formants": [[freq, bandwidth], ...5]}, ...]
+	json_t *toJson() override {
+		std::lock_guard<std::mutex> lock(vowelsMutex);
+		json_t *rootJ = json_object();
+		json_t *vowelsJ = json_array();
+		for (int i = 0; i < numVowels; i++) {
+			const VowelFormants &vowel = vowels[i];
+			json_t *vowelJ = json_object();
+			json_object_set_new(vowelJ, "level", json_real(vowel.level));
+			json_t *formantsJ = json_array();
+			for (int k = 0; k < FORMANT_SECTIONS; k++) {
+				json_t *formantJ = json_array();
+				json_array_append_new(formantJ, json_real(vowel.formants[k].freq));
+				json_array_append_new(formantJ, json_real(vowel.formants[k].bandwidth));
+				json_array_append_new(formantsJ, formantJ);
+			}
+			json_object_set_new(vowelJ, "formants", formantsJ);
+			json_array_append_new(vowelsJ, vowelJ);
+		}
+		json_object_set_new(rootJ, "vowels", vowelsJ);
+		return rootJ;
+	}
+
+	static bool readNumber(json_t *numberJ, double *value) {
+		if (!json_is_number(numberJ))
+			return false;
+		*value = json_number_value(numberJ);
+		return std::isfinite(*value);
+	}
+
+	// Keeps the current set unless every vowel has a finite level and all its
+	// formants, with frequencies and bandwidths above 0 Hz
+	void fromJson(json_t *rootJ) override {
+		json_t *vowelsJ = json_object_get(rootJ, "vowels");
+		if (!vowelsJ)
+			return;
+		VowelFormants newVowels[FORMANT_MAX_VOWELS];
+		int newNumVowels = json_array_size(vowelsJ);
+		if (newNumVowels < 1 || newNumVowels > FORMANT_MAX_VOWELS)
+			return;
+		for (int i = 0; i < newNumVowels; i++) {
+			json_t *vowelJ = json_array_get(vowelsJ, i);
+			json_t *formantsJ = json_object_get(vowelJ, "formants");
+			if (!readNumber(json_object_get(vowelJ, "level"), &newVowels[i].level))
+				return;
+			if (json_array_size(formantsJ) != FORMANT_SECTIONS)
+				return;
+			for (int k = 0; k < FORMANT_SECTIONS; k++) {
+				json_t *formantJ = json_array_get(formantsJ, k);
+				Formant &formant = newVowels[i].formants[k];
+				if (json_array_size(formantJ) != 2)
+					return;
+				if (!readNumber(json_array_get(formantJ, 0), &formant.freq) || formant.freq <= 0.0)
+					return;
+				if (!readNumber(json_array_get(formantJ, 1), &formant.bandwidth) || formant.bandwidth <= 0.0)
+					return;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(vowelsMutex);
+		for (int i = 0; i < newNumVowels; i++)
+			vowels[i] = newVowels[i];
+		numVowels = newNumVowels;
+		pendingSampleRate = engineGetSampleRate();
+		generateFormantTable(vowels, numVowels, bank.getResolution(), pendingSampleRate, pendingTable);
+		vowelsPending = true;
+	}
 };
  
 FormantFilter::FormantFilter() {
@@ -189,25 +128,35 @@ FormantFilter::FormantFilter() {
 	inputs.resize(NUM_INPUTS);
 	outputs.resize(NUM_OUTPUTS);
 
-
+	bank.setSampleRate(engineGetSampleRate());
+	for (int i = 0; i < 5; i++)
+		vowels[i] = formantVowelsAEIOU[i];
+	numVowels = 5;
+	pendingSampleRate = 0.0;
+	vowelsPending = false;
 }
 
 
-float ffilterout;
-
-
-
 void FormantFilter::step() {
+	if (vowelsPending) {
+		std::unique_lock<std::mutex> lock(vowelsMutex, std::try_to_lock);
+		if (lock.owns_lock()) {
+			bank.swapVowels(vowels, numVowels, pendingTable, pendingSampleRate);
+			vowelsPending = false;
+		}
+	}
+
 	float in = inputs[INPUT].value / 5.0;
 	
-	int vowel = params[VOWEL_PARAM].value;
+	float vowel = params[VOWEL_PARAM].value;
 	
 	float cv = clampf(inputs[CV_VOWEL].value * params[ATTEN_PARAM].value, 0, 8) ;
 	
-	ffilterout= ffilter->formant_filter(in,clampf((vowel+cv), 0, 8), 0);
-
+	// The knob and CV sweep all the vowels, morphing continuously in between;
+	// with the five default vowels, a vowel on every other step of the knob
+	bank.setMorph(clampf(vowel + cv, 0, 8) / 8.0 * (bank.getNumVowels() - 1));
 
-	outputs[OUTPUT].value= 5.0*ffilterout; 
+	outputs[OUTPUT].value= 5.0*bank.process(in); 
 
 
 }
@@ -42,10 +42,8 @@ struct MultiModeFilter : Module{
 
 
 	MultiModeFilter();
-VAStateVariableFilter *lpFilter = new VAStateVariableFilter() ;	// create a lpFilter;
-VAStateVariableFilter *hpFilter = new VAStateVariableFilter() ;	// create a lpFilter;
-VAStateVariableFilter *bpFilter = new VAStateVariableFilter() ;	// create a lpFilter;
-VAStateVariableFilter *npFilter = new VAStateVariableFilter() ;	// create a lpFilter;
+	// One filter for all four outputs, they share its state
+	VAStateVariableFilter filter;
 
 
 	void step();
@@ -69,13 +67,6 @@ MultiModeFilter::MultiModeFilter() {
 	outputs.resize(NUM_OUTPUTS);
 }
 
-float outLP;
-float outHP;
-float outBP;
-float outNP;
-
-
-
 //VAStateVariableFilter *peakFilter = new VAStateVariableFilter();
 
 float minfreq = 15.0;
@@ -85,7 +76,10 @@ float maxfreq = 12000;
 
 void MultiModeFilter::step() {
 	
-	
+	// The four outputs come from one state update, which any connected output needs,
+	// so only a module with nothing connected skips the filter
+	if (!outputs[OUTLPF].active && !outputs[OUTHPF].active && !outputs[OUTBPF].active && !outputs[OUTNPF].active)
+		return;
 
 	float input = inputs[INPUT].value / 5.0;
 	float drive = params[DRIVE_PARAM].value + inputs[DRIVE_INPUT].value / 10.0;
@@ -108,52 +102,26 @@ void MultiModeFilter::step() {
 
  
 
-	lpFilter->setFilterType(0);
-	hpFilter->setFilterType(2);
-	bpFilter->setFilterType(1);
-	npFilter->setFilterType(5);
-
-	
-lpFilter->setCutoffFreq(cutoff);
-hpFilter->setCutoffFreq(cutoff); 
-bpFilter->setCutoffFreq(cutoff);
-npFilter->setCutoffFreq(cutoff);
-
-
-lpFilter->setResonance(res);
-hpFilter->setResonance(res);
-bpFilter->setResonance(res);
-npFilter->setResonance(res);
-
-
-
-
-
-lpFilter->setSampleRate(engineGetSampleRate());
-hpFilter->setSampleRate(engineGetSampleRate());
-bpFilter->setSampleRate(engineGetSampleRate());
-npFilter->setSampleRate(engineGetSampleRate());
-
-
-
-
-
-outLP = lpFilter->processAudioSample(input,1);
-outHP = hpFilter->processAudioSample(input,1);
-outBP = bpFilter->processAudioSample(input,1);
-outNP = npFilter->processAudioSample(input,1);
-
-
-
-
-	outputs[OUTLPF].value=outLP*5;
-	outputs[OUTHPF].value= outHP*5;
-	outputs[OUTBPF].value= outBP*5;
-	outputs[OUTNPF].value= outNP*5;
-
-	
-
-
+	// Knob sweeps are smoothed, with new coefficients once per control block instead
+	// of on every sample. Patched cutoff CV may be audio rate, so it is followed
+	// sample by sample.
+	bool modulated = inputs[FREQ_INPUT].active || inputs[FREQ_INPUT2].active;
+	filter.setSmoothingTimeInMs(modulated ? 0.0 : 10.0);
+
+	// Only recalculates the coefficients when the cutoff, resonance or sample rate moved
+	filter.setParameters(cutoff, res, engineGetSampleRate());
+
+	SVFOutputs out;
+	filter.processAudioSampleAll(input, 0, out);
+
+	if (outputs[OUTLPF].active)
+		outputs[OUTLPF].value= out.lowpass*5;
+	if (outputs[OUTHPF].active)
+		outputs[OUTHPF].value= out.highpass*5;
+	if (outputs[OUTBPF].active)
+		outputs[OUTBPF].value= out.bandpass*5;
+	if (outputs[OUTNPF].active)
+		outputs[OUTNPF].value= out.notch*5;
 
 }
 
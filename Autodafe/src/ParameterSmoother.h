@@ -0,0 +1,178 @@
+/*
+ ==============================================================================
+
+ ParameterSmoother.h
+
+ Notes:
+ Smoothers for parameters that move in steps (knobs, CV read at control
+ rate), so that the coefficients computed from them do not zipper.
+ Both advance one sample at a time with getNextValue(), or a whole control
+ block at a time with skip(), which lets a filter recompute its coefficients
+ once per block and interpolate them in between.
+
+ - LinearSmoothedValue ramps to each new target in a fixed time.
+ - OnePoleSmoothedValue approaches it exponentially with a time constant, so
+   a target that keeps moving is followed without restarting a ramp.
+
+ ==============================================================================
+ */
+
+#ifndef PARAMETERSMOOTHER_H
+#define PARAMETERSMOOTHER_H
+
+//==============================================================================
+
+#include <cmath>
+
+//==============================================================================
+class LinearSmoothedValue {
+public:
+    LinearSmoothedValue(float initialValue = 0.0f)
+        : currentValue(initialValue), target(initialValue), step(0.0f),
+          countdown(0), stepsToTarget(0)
+    {
+    }
+
+    //------------------------------------------------------------------------------
+    /**	Sets the ramp length, and jumps to the target. */
+    void reset(double sampleRate, double rampLengthInSeconds)
+    {
+        stepsToTarget = static_cast<int>(std::floor(rampLengthInSeconds * sampleRate));
+        currentValue = target;
+        countdown = 0;
+    }
+
+    //------------------------------------------------------------------------------
+    /**	Starts a ramp from the current value to newValue. Setting the same target
+        again does not restart the ramp, so this can be called on every sample.
+    */
+    void setValue(float newValue)
+    {
+        if (target != newValue) {
+            target = newValue;
+            countdown = stepsToTarget;
+            if (countdown <= 0)
+                currentValue = target;
+            else
+                step = (target - currentValue) / countdown;
+        }
+    }
+
+    //------------------------------------------------------------------------------
+    /**	Jumps to newValue, without a ramp. */
+    void setCurrentAndTargetValue(float newValue)
+    {
+        target = currentValue = newValue;
+        countdown = 0;
+    }
+
+    //------------------------------------------------------------------------------
+    /**	Advances by one sample and returns the new value. */
+    float getNextValue()
+    {
+        if (countdown <= 0)
+            return target;
+        --countdown;
+        currentValue = (countdown > 0) ? currentValue + step : target;
+        return currentValue;
+    }
+
+    //------------------------------------------------------------------------------
+    /**	Advances by numSamples, for control-rate updates. */
+    void skip(int numSamples)
+    {
+        if (numSamples >= countdown) {
+            currentValue = target;
+            countdown = 0;
+        }
+        else {
+            currentValue += step * numSamples;
+            countdown -= numSamples;
+        }
+    }
+
+    //------------------------------------------------------------------------------
+
+    float getCurrentValue() const { return currentValue; }
+
+    float getTargetValue() const { return target; }
+
+    bool isSmoothing() const { return countdown > 0; }
+
+private:
+    float currentValue, target, step;
+    int countdown, stepsToTarget;
+};
+
+//==============================================================================
+class OnePoleSmoothedValue {
+public:
+    OnePoleSmoothedValue(float initialValue = 0.0f)
+        : currentValue(initialValue), target(initialValue), coeff(0.0f),
+          skipSamples(0), skipCoeff(0.0f)
+    {
+    }
+
+    //------------------------------------------------------------------------------
+    /**	Sets the time constant (the time to cover 63% of a step), and jumps to the
+        target.
+    */
+    void reset(double sampleRate, double timeConstantInSeconds)
+    {
+        coeff = (timeConstantInSeconds > 0.0)
+            ? static_cast<float>(std::exp(-1.0 / (timeConstantInSeconds * sampleRate))) : 0.0f;
+        skipSamples = 0;
+        currentValue = target;
+    }
+
+    //------------------------------------------------------------------------------
+
+    void setValue(float newValue) { target = newValue; }
+
+    void setCurrentAndTargetValue(float newValue) { target = currentValue = newValue; }
+
+    //------------------------------------------------------------------------------
+    /**	Advances by one sample and returns the new value. */
+    float getNextValue()
+    {
+        currentValue = target + coeff * (currentValue - target);
+        if (!isSmoothing())
+            currentValue = target;
+        return currentValue;
+    }
+
+    //------------------------------------------------------------------------------
+    /**	Advances by numSamples, for control-rate updates. The decay over a block is
+        only computed again when the block length changes.
+    */
+    void skip(int numSamples)
+    {
+        if (numSamples != skipSamples) {
+            skipSamples = numSamples;
+            skipCoeff = std::pow(coeff, static_cast<float>(numSamples));
+        }
+        currentValue = target + skipCoeff * (currentValue - target);
+        if (!isSmoothing())
+            currentValue = target;
+    }
+
+    //------------------------------------------------------------------------------
+
+    float getCurrentValue() const { return currentValue; }
+
+    float getTargetValue() const { return target; }
+
+    /** Within 1e-5 (relative) of the target counts as there. */
+    bool isSmoothing() const
+    {
+        return std::fabs(currentValue - target) > 1.0e-5f * (std::fabs(target) + 1.0e-5f);
+    }
+
+private:
+    float currentValue, target, coeff;
+    int skipSamples;
+    float skipCoeff;
+};
+
+//==============================================================================
+#endif  // PARAMETERSMOOTHER_H
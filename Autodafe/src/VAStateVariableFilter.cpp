@@ -22,12 +22,17 @@ VAStateVariableFilter::VAStateVariableFilter()
     KCoeff = 0.0f;
 
     cutoffFreq = 1000.0f;
-    Q = static_cast<float>(resonanceToQ(0.5));
+    resonance = 0.5f;
+    Q = static_cast<float>(resonanceToQ(resonance));
+    shelfGain = 0.0f;
 
     z1_A[0] = z2_A[0] = 0.0f;
     z1_A[1] = z2_A[1] = 0.0f;
 
-    //smoothTimeMs = 0.0;		        // 0.0 milliseconds
+    smoothTimeMs = 0.0f;		        // 0.0 milliseconds
+    cutoffLinSmooth.setCurrentAndTargetValue(cutoffFreq);
+    controlCountdown = 0;
+    gTarget = gStep = 0.0f;
 }
 
 VAStateVariableFilter::~VAStateVariableFilter()
@@ -43,24 +48,26 @@ void VAStateVariableFilter::setFilterType(const int& newType)
 
 void VAStateVariableFilter::setCutoffPitch(const float& newCutoffPitch)
 {
-    if (active) {
-        cutoffFreq = static_cast<float>(pitchToFreq(newCutoffPitch));
-        //cutoffLinSmooth.setValue(cutoffFreq);
-        calcFilter();
-    }
+    setCutoffFreq(static_cast<float>(pitchToFreq(newCutoffPitch)));
 }
 
 void VAStateVariableFilter::setCutoffFreq(const float& newCutoffFreq)
 {
     if (active) {
-        cutoffFreq = newCutoffFreq;
-        calcFilter();
+        if (smoothTimeMs > 0.0f) {
+            cutoffLinSmooth.setValue(newCutoffFreq);
+        }
+        else {
+            cutoffFreq = newCutoffFreq;
+            calcFilter();
+        }
     }
 }
 
 void VAStateVariableFilter::setResonance(const float& newResonance)
 {
     if (active) {
+        resonance = newResonance;
         Q = static_cast<float>(resonanceToQ(newResonance));
         calcFilter();
     }
@@ -69,6 +76,7 @@ void VAStateVariableFilter::setResonance(const float& newResonance)
 void VAStateVariableFilter::setQ(const float& newQ)
 {
     if (active) {
+        resonance = -1.0f;
         Q = newQ;
         calcFilter();
     }
@@ -87,22 +95,69 @@ void VAStateVariableFilter::setFilter(const int& newType, const float& newCutoff
 {
     filterType = newType;
     cutoffFreq = newCutoffFreq;
+    resonance = newResonance;
     Q = static_cast<float>(resonanceToQ(newResonance));
     shelfGain = newShelfGain;
+    cutoffLinSmooth.setCurrentAndTargetValue(cutoffFreq);
+    controlCountdown = 0;
     calcFilter();
 }
 
 void VAStateVariableFilter::setSampleRate(const float& newSampleRate)
 {
     sampleRate = newSampleRate;
-    //cutoffLinSmooth.reset(sampleRate, smoothTimeMs);
+    if (smoothTimeMs > 0.0f) {
+        // Jump to the target, the ramp length in samples changed
+        cutoffLinSmooth.reset(sampleRate, smoothTimeMs / 1000.0f);
+        cutoffFreq = cutoffLinSmooth.getCurrentValue();
+        controlCountdown = 0;
+    }
     calcFilter();
 }
 
-/*void VAStateVariableFilter::setSmoothingTimeInMs(const float & newSmoothingTimeMs)
+void VAStateVariableFilter::setParameters(const float& newCutoffFreq, const float& newResonance,
+                                          const float& newSampleRate)
+{
+    if (active && newResonance == resonance && newSampleRate == sampleRate) {
+        if (smoothTimeMs > 0.0f)
+            cutoffLinSmooth.setValue(newCutoffFreq);
+        else if (newCutoffFreq != cutoffFreq)
+            setCutoffFreqFast(newCutoffFreq);
+    }
+    else if (active) {
+        if (newResonance != resonance) {
+            resonance = newResonance;
+            Q = static_cast<float>(resonanceToQ(newResonance));
+        }
+        if (newSampleRate != sampleRate) {
+            sampleRate = newSampleRate;
+            // Jump to the new cutoff, the ramp length in samples changed
+            cutoffLinSmooth.reset(sampleRate, smoothTimeMs / 1000.0f);
+            cutoffLinSmooth.setCurrentAndTargetValue(newCutoffFreq);
+            cutoffFreq = newCutoffFreq;
+            controlCountdown = 0;
+        }
+        else if (smoothTimeMs > 0.0f) {
+            cutoffLinSmooth.setValue(newCutoffFreq);
+        }
+        else {
+            cutoffFreq = newCutoffFreq;
+        }
+        calcFilter();
+    }
+}
+
+void VAStateVariableFilter::setSmoothingTimeInMs(const float& newSmoothingTimeMs)
 {
-    smoothTimeMs = newSmoothingTimeMs;
-}*/
+    if (newSmoothingTimeMs != smoothTimeMs) {
+        smoothTimeMs = newSmoothingTimeMs;
+        // Restart from where the cutoff is now, with the gain exact for it
+        cutoffLinSmooth.reset(sampleRate, smoothTimeMs / 1000.0f);
+        cutoffLinSmooth.setCurrentAndTargetValue(cutoffFreq);
+        controlCountdown = 0;
+        calcFilter();
+    }
+}
 
 void VAStateVariableFilter::setIsActive(bool isActive)
 {
@@ -120,7 +175,17 @@ void VAStateVariableFilter::calcFilter()
         float wa = (2.0f / T) * tan(wd * T / 2.0f);
 
         // Calculate g (gain element of integrator)
-        gCoeff = wa * T / 2.0f;			// Calculate g (gain element of integrator)
+        const float g = wa * T / 2.0f;
+
+        // In the middle of a smoothing control block, cutoffFreq is where the block
+        // ends, so ramp the rest of the way there instead of jumping.
+        if (controlCountdown > 0) {
+            gTarget = g;
+            gStep = (gTarget - gCoeff) / controlCountdown;
+        }
+        else {
+            gCoeff = g;
+        }
 
         // Calculate Zavalishin's R from Q (referred to as damping parameter)
         RCoeff = 1.0f / (2.0f * Q);		
@@ -135,8 +200,8 @@ float VAStateVariableFilter::processAudioSample(const float& input, const int& c
     if (active) {
 
         // Do the cutoff parameter smoothing per sample.
-        //cutoffFreq = cutoffLinSmooth.getNextValue();
-        //calcFilter();
+        if (smoothTimeMs > 0.0f)
+            tickSmoothing();
 
         // Filter processing:
         const float HP = (input - (2.0f * RCoeff + gCoeff) * z1_A[channelIndex] - z2_A[channelIndex])
@@ -195,6 +260,42 @@ float VAStateVariableFilter::processAudioSample(const float& input, const int& c
     }
 }
 
+void VAStateVariableFilter::processAudioSampleAll(const float& input, const int& channelIndex,
+                                                 SVFOutputs& outputs)
+{
+    if (active) {
+
+        if (smoothTimeMs > 0.0f)
+            tickSmoothing();
+
+        // Filter processing:
+        const float HP = (input - (2.0f * RCoeff + gCoeff) * z1_A[channelIndex] - z2_A[channelIndex])
+            / (1.0f + (2.0f * RCoeff * gCoeff) + gCoeff * gCoeff);
+
+        const float BP = HP * gCoeff + z1_A[channelIndex];
+
+        const float LP = BP * gCoeff + z2_A[channelIndex];
+
+        const float UBP = 2.0f * RCoeff * BP;
+
+        z1_A[channelIndex] = gCoeff * HP + BP;		// unit delay (state variable)
+        z2_A[channelIndex] = gCoeff * BP + LP;		// unit delay (state variable)
+
+        outputs.lowpass = LP;
+        outputs.bandpass = BP;
+        outputs.highpass = HP;
+        outputs.unitGainBandpass = UBP;
+        outputs.bandShelving = input + UBP * KCoeff;
+        outputs.notch = input - UBP;
+        outputs.allpass = input - (4.0f * RCoeff * BP);
+        outputs.peak = LP - HP;
+    }
+    else {	// If not active, pass the input through
+        outputs.lowpass = outputs.bandpass = outputs.highpass = outputs.unitGainBandpass = input;
+        outputs.bandShelving = outputs.notch = outputs.allpass = outputs.peak = input;
+    }
+}
+
 void VAStateVariableFilter::processAudioBlock(float* const samples,  const int& numSamples, 
                                               const int& channelIndex)
 {
@@ -205,8 +306,8 @@ void VAStateVariableFilter::processAudioBlock(float* const samples,  const int&
         for (int i = 0; i < numSamples; ++i) {
             
             // Do the cutoff parameter smoothing per sample.
-            //cutoffFreq = cutoffLinSmooth.getNextValue();
-            //calcFilter();       // calculate the coefficients for the smoother
+            if (smoothTimeMs > 0.0f)
+                tickSmoothing();
 
             // Filter processing:
             const float input = samples[i];
@@ -266,3 +367,118 @@ void VAStateVariableFilter::processAudioBlock(float* const samples,  const int&
 }
 
 //==============================================================================
+
+//==============================================================================
+/*  Benchmark: MultiModeFilter's per-sample work, with the four single-output
+    filters it used to run and with one filter returning all outputs, for a
+    fixed cutoff and for a cutoff under audio-rate modulation. Then the cost of
+    audio-rate cutoff modulation with the exact and the fast setters, and the
+    largest error of the fast prewarp up to Nyquist. Last, a knob swept in
+    steps of one UI frame, with the coefficients set on every sample and with
+    10 ms of smoothing at control rate, and the largest cutoff jump per block.
+    Build with DSPUtilities.cpp.
+*/
+#if 0
+#include <chrono>
+#include <cstdio>
+
+int main()
+{
+    const int numSamples = 10000000;
+    const float sampleRate = 44100.0f;
+    float sink = 0.0f;
+
+    for (int modulated = 0; modulated < 2; modulated++) {
+        VAStateVariableFilter filters[4];
+        const int types[4] = { SVFLowpass, SVFHighpass, SVFBandpass, SVFNotch };
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numSamples; i++) {
+            float cutoff = modulated ? 1000.0f + 500.0f * ((i & 127) / 128.0f) : 1000.0f;
+            float input = ((i * 7919u) % 1000u) / 1000.0f - 0.5f;
+            for (int f = 0; f < 4; f++) {
+                filters[f].setFilterType(types[f]);
+                filters[f].setCutoffFreq(cutoff);
+                filters[f].setResonance(0.5f);
+                filters[f].setSampleRate(sampleRate);
+                sink += filters[f].processAudioSample(input, 1);
+            }
+        }
+        std::chrono::duration<double> before = std::chrono::steady_clock::now() - start;
+
+        VAStateVariableFilter filter;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numSamples; i++) {
+            float cutoff = modulated ? 1000.0f + 500.0f * ((i & 127) / 128.0f) : 1000.0f;
+            float input = ((i * 7919u) % 1000u) / 1000.0f - 0.5f;
+            SVFOutputs out;
+            filter.setParameters(cutoff, 0.5f, sampleRate);
+            filter.processAudioSampleAll(input, 0, out);
+            sink += out.lowpass + out.highpass + out.bandpass + out.notch;
+        }
+        std::chrono::duration<double> after = std::chrono::steady_clock::now() - start;
+
+        printf("%s cutoff: four filters %.1f ns/sample, one filter %.1f ns/sample (%.1fx)\n",
+               modulated ? "modulated" : "fixed", 1e9 * before.count() / numSamples,
+               1e9 * after.count() / numSamples, before.count() / after.count());
+    }
+    for (int pitch = 0; pitch < 2; pitch++) {
+        VAStateVariableFilter exact, fast;
+        exact.setSampleRate(sampleRate);
+        fast.setSampleRate(sampleRate);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numSamples; i++) {
+            float input = ((i * 7919u) % 1000u) / 1000.0f - 0.5f;
+            if (pitch)
+                exact.setCutoffPitch(60.0f + 24.0f * input);
+            else
+                exact.setCutoffFreq(1000.0f + 900.0f * input);
+            sink += exact.processAudioSample(input, 0);
+        }
+        std::chrono::duration<double> before = std::chrono::steady_clock::now() - start;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numSamples; i++) {
+            float input = ((i * 7919u) % 1000u) / 1000.0f - 0.5f;
+            if (pitch)
+                fast.setCutoffPitchFast(60.0f + 24.0f * input);
+            else
+                fast.setCutoffFreqFast(1000.0f + 900.0f * input);
+            sink += fast.processAudioSample(input, 0);
+        }
+        std::chrono::duration<double> after = std::chrono::steady_clock::now() - start;
+        printf("%s modulation: exact %.1f ns/sample, fast %.1f ns/sample (%.1fx)\n",
+               pitch ? "pitch" : "frequency", 1e9 * before.count() / numSamples,
+               1e9 * after.count() / numSamples, before.count() / after.count());
+    }
+
+    for (int smoothed = 0; smoothed < 2; smoothed++) {
+        VAStateVariableFilter filter;
+        filter.setSmoothingTimeInMs(smoothed ? 10.0f : 0.0f);
+        float maxJump = 0.0f, lastCutoff = 0.0f;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numSamples; i++) {
+            float knob = 200.0f + 100.0f * ((i / 735u) % 64u);	// new value every 60th s
+            float input = ((i * 7919u) % 1000u) / 1000.0f - 0.5f;
+            SVFOutputs out;
+            filter.setParameters(knob, 0.5f, sampleRate);
+            filter.processAudioSampleAll(input, 0, out);
+            sink += out.lowpass + out.highpass + out.bandpass + out.notch;
+            if (i > 0)
+                maxJump = fmax(maxJump, fabs(filter.getCutoff() - lastCutoff));
+            lastCutoff = filter.getCutoff();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        printf("knob sweep, %s: %.1f ns/sample, largest cutoff jump %.0f Hz\n",
+               smoothed ? "smoothed at control rate" : "coefficients per sample",
+               1e9 * elapsed.count() / numSamples, maxJump);
+    }
+
+    double maxError = 0.0;
+    for (int i = 1; i < 1000000; i++) {
+        float x = 0.5f * i / 1000000.0f;
+        maxError = fmax(maxError, fabs(fastTanPi(x) / tan(M_PI * x) - 1.0));
+    }
+    printf("fastTanPi: max relative error %.2g up to Nyquist\n", maxError);
+    printf("(%g)\n", sink);
+    return 0;
+}
+#endif
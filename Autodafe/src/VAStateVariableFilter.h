@@ -37,6 +37,7 @@
 
 #include <cmath>
 #include "DSPUtilities.h"
+#include "ParameterSmoother.h"
 //==============================================================================
 
 using std::pow;
@@ -57,6 +58,20 @@ enum SVFType {
     SVFPeak
 };
 
+//==============================================================================
+
+/** Every output type of the filter for one input sample. */
+struct SVFOutputs {
+    float lowpass;
+    float bandpass;
+    float highpass;
+    float unitGainBandpass;
+    float bandShelving;
+    float notch;
+    float allpass;
+    float peak;
+};
+
 //==============================================================================
 class VAStateVariableFilter {
 public:
@@ -93,6 +108,30 @@ public:
     /**	Used for changing the filter's cutoff parameter linearly by frequency (Hz) */
     void setCutoffFreq(const float& newCutoff);
 
+    //------------------------------------------------------------------------------
+    /**	Variants of setCutoffPitch() and setCutoffFreq() for modulating the cutoff
+        on every sample, at audio rate. They only update the integrator gain, with
+        fastPitchToFreq() and fastTanPi() instead of pow() and tan(). For any cutoff
+        up to Nyquist, the gain is within 3e-7 (relative) of the tan() of the same
+        cutoff / sampleRate ratio.
+    */
+    void setCutoffPitchFast(const float& newCutoff)
+    {
+        setCutoffFreqFast(fastPitchToFreq(newCutoff));
+    }
+
+    void setCutoffFreqFast(const float& newCutoff)
+    {
+        if (active) {
+            cutoffFreq = newCutoff;
+            gCoeff = fastTanPi(cutoffFreq / sampleRate);
+            if (smoothTimeMs > 0.0f) {
+                cutoffLinSmooth.setCurrentAndTargetValue(cutoffFreq);
+                controlCountdown = 0;
+            }
+        }
+    }
+
     //------------------------------------------------------------------------------
     /** Used for setting the resonance amount. This is then converted to a Q
         value, which is used by the filter.
@@ -122,12 +161,31 @@ public:
     */
     void setSampleRate(const float& newSampleRate);
 
+    //------------------------------------------------------------------------------
+    /**	Sets the cutoff (Hz), resonance (0-1) and sample rate at once. The coefficients
+        are only recalculated when one of them changed, and a change of the cutoff
+        alone goes through setCutoffFreqFast(), so this can be called on every
+        sample with the current knob and CV values. With smoothing on, a new cutoff
+        only becomes the target of the smoother.
+    */
+    void setParameters(const float& newCutoff, const float& newResonance,
+                       const float& newSampleRate);
+
     //------------------------------------------------------------------------------
     /**	Sets the time that it takes to interpolate between the previous value and
         the current value. For this filter, the smoothing is only happening for
-        the filters cutoff frequency.
+        the filters cutoff frequency. 0 (the default) turns smoothing off.
+
+        While smoothing, setCutoffFreq(), setCutoffPitch() and setParameters() only
+        set the target. The processing functions then advance the smoother once
+        every controlBlockSize samples, calculate the integrator gain for the end of
+        that block, and interpolate the gain linearly across it. So the prewarp
+        runs at control rate, and the gain still moves on every sample.
     */
-    //void setSmoothingTimeInMs(const float& newSmoothingTimeMs);
+    void setSmoothingTimeInMs(const float& newSmoothingTimeMs);
+
+    /** Samples between two coefficient updates while smoothing. */
+    static const int controlBlockSize = 16;
 
     //------------------------------------------------------------------------------
     /** Sets whether the filter will process data or not.
@@ -143,6 +201,14 @@ public:
     */
     float processAudioSample(const float& input, const int& channelIndex);
 
+    //------------------------------------------------------------------------------
+    /**	Processes one sample like processAudioSample(), but returns every filter
+        type from the same state update, whatever the type set with setFilterType().
+        If the filter is not active, every output is the input.
+    */
+    void processAudioSampleAll(const float& input, const int& channelIndex,
+                               SVFOutputs& outputs);
+
     //------------------------------------------------------------------------------	
     /**	Performs the actual processing for a block of samples, on 2 channels.
         If 2 channels are needed (stereo), use channel index (channelIdx) to 
@@ -171,10 +237,28 @@ private:
     //	Calculate the coefficients for the filter based on parameters.
     void calcFilter();
 
+    //	Advances the cutoff smoothing by one sample, called before processing it.
+    void tickSmoothing()
+    {
+        if (controlCountdown == 0) {
+            if (!cutoffLinSmooth.isSmoothing())
+                return;
+            // Start a control block: where the gain should be at its end
+            cutoffLinSmooth.skip(controlBlockSize);
+            cutoffFreq = cutoffLinSmooth.getCurrentValue();
+            gTarget = fastTanPi(cutoffFreq / sampleRate);
+            gStep = (gTarget - gCoeff) / controlBlockSize;
+            controlCountdown = controlBlockSize;
+        }
+        // Land exactly on the target, whatever the rounding of the steps
+        gCoeff = (--controlCountdown == 0) ? gTarget : gCoeff + gStep;
+    }
+
     //	Parameters:
     int filterType;
     float cutoffFreq;
     float Q;
+    float resonance;	// that Q was set from, or -1 after setQ()
     float shelfGain;
 
     float sampleRate;
@@ -188,28 +272,13 @@ private:
     float z1_A[2], z2_A[2];		// state variables (z^-1)
 
     // Parameter smoothers:
-    //LinearSmoothedValue cutoffLinSmooth;
-    //double smoothTimeMs;
+    LinearSmoothedValue cutoffLinSmooth;
+    float smoothTimeMs;
+    int controlCountdown;	// samples left in the current control block
+    float gTarget;		// gain at the end of the control block
+    float gStep;		// change of the gain per sample across the block
 };
 
 //==============================================================================
 #endif  // VASTATEVARIABLEFILTER_H_INCLUDED
 
-
-/*
- ==============================================================================
- 
- ParameterSmoother.h
- Created: 1 May 2015 12:43:46am
- Author:  Jordan Harris
- 
- ==============================================================================
- */
-
-/*
- Useful DSP utilities. For instance, calculating frequency from a given
- pitch (MIDI) value, or vice versa.
- */
-
-//==============================================================================
-
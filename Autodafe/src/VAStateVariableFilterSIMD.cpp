@@ -0,0 +1,178 @@
+/*
+  ==============================================================================
+
+    VAStateVariableFilterSIMD.cpp
+
+  ==============================================================================
+*/
+
+#include "VAStateVariableFilterSIMD.h"
+
+//==============================================================================
+
+VAStateVariableFilterSIMD::VAStateVariableFilterSIMD()
+{
+    sampleRate = 44100.0f;				// default sample rate when constructed
+
+    for (int lane = 0; lane < numLanes; ++lane) {
+        cutoffFreq[lane] = 1000.0f;
+        resonance[lane] = 0.5f;
+        KCoeff[lane] = 0.0f;
+        calcLane(lane);
+    }
+    reset();
+}
+
+// Member functions for setting the filter's parameters (and sample rate).
+//==============================================================================
+void VAStateVariableFilterSIMD::setSampleRate(const float& newSampleRate)
+{
+    sampleRate = newSampleRate;
+    for (int lane = 0; lane < numLanes; ++lane)
+        calcLane(lane);
+}
+
+void VAStateVariableFilterSIMD::setCutoffFreq(const int& lane, const float& newCutoffFreq)
+{
+    cutoffFreq[lane] = newCutoffFreq;
+    calcLane(lane);
+}
+
+void VAStateVariableFilterSIMD::setCutoffFreqs(const float* newCutoffFreqs)
+{
+    for (int lane = 0; lane < numLanes; ++lane) {
+        cutoffFreq[lane] = newCutoffFreqs[lane];
+        const float g = fastTanPi(cutoffFreq[lane] / sampleRate);
+        gCoeff[lane] = g;
+        HPScale[lane] = 1.0f / (1.0f + R2Coeff[lane] * g + g * g);
+    }
+}
+
+void VAStateVariableFilterSIMD::setResonance(const int& lane, const float& newResonance)
+{
+    resonance[lane] = newResonance;
+    calcLane(lane);
+}
+
+void VAStateVariableFilterSIMD::setResonances(const float* newResonances)
+{
+    for (int lane = 0; lane < numLanes; ++lane) {
+        if (newResonances[lane] != resonance[lane]) {
+            resonance[lane] = newResonances[lane];
+            calcLane(lane);
+        }
+    }
+}
+
+void VAStateVariableFilterSIMD::setShelfGain(const int& lane, const float& newGain)
+{
+    KCoeff[lane] = newGain;
+}
+
+void VAStateVariableFilterSIMD::reset()
+{
+    for (int lane = 0; lane < numLanes; ++lane)
+        z1_A[lane] = z2_A[lane] = 0.0f;
+}
+
+//==============================================================================
+void VAStateVariableFilterSIMD::calcLane(int lane)
+{
+    // prewarp the cutoff (for bilinear-transform filters)
+    const float g = static_cast<float>(tan(M_PI * cutoffFreq[lane] / sampleRate));
+    const float Q = static_cast<float>(resonanceToQ(resonance[lane]));
+
+    gCoeff[lane] = g;
+    R2Coeff[lane] = 1.0f / Q;		// 2R, with Zavalishin's damping R = 1 / (2Q)
+    HPScale[lane] = 1.0f / (1.0f + R2Coeff[lane] * g + g * g);
+}
+
+//==============================================================================
+/*  Benchmark: lanes of filtering per microsecond (one sample of one lane each),
+    with numLanes scalar VAStateVariableFilters and with one SIMD filter, for
+    fixed cutoffs and for cutoffs modulated on every sample. Also checks that
+    the lanes follow the scalar filter.
+    Build with VAStateVariableFilter.cpp and DSPUtilities.cpp, with and without
+    -mavx.
+*/
+#if 0
+#include <chrono>
+#include <cstdio>
+
+int main()
+{
+    const int numSamples = 10000000;
+    const int numLanes = VAStateVariableFilterSIMD::numLanes;
+    float sink = 0.0f;
+    double maxError = 0.0;
+
+    for (int modulated = 0; modulated < 2; modulated++) {
+        VAStateVariableFilter scalar[numLanes];
+        VAStateVariableFilterSIMD simd;
+        for (int lane = 0; lane < numLanes; lane++) {
+            scalar[lane].setParameters(200.0f * (lane + 1), 0.1f * lane, 44100.0f);
+            simd.setCutoffFreq(lane, 200.0f * (lane + 1));
+            simd.setResonance(lane, 0.1f * lane);
+        }
+        simd.setSampleRate(44100.0f);
+
+        float input[numLanes], cutoffs[numLanes];
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numSamples; i++) {
+            for (int lane = 0; lane < numLanes; lane++) {
+                input[lane] = (((i + lane) * 7919u) % 1000u) / 1000.0f - 0.5f;
+                SVFOutputs out;
+                if (modulated)
+                    scalar[lane].setCutoffFreqFast(200.0f * (lane + 1) + 100.0f * input[lane]);
+                scalar[lane].processAudioSampleAll(input[lane], 0, out);
+                sink += out.lowpass;
+            }
+        }
+        std::chrono::duration<double> before = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numSamples; i++) {
+            for (int lane = 0; lane < numLanes; lane++) {
+                input[lane] = (((i + lane) * 7919u) % 1000u) / 1000.0f - 0.5f;
+                cutoffs[lane] = 200.0f * (lane + 1) + 100.0f * input[lane];
+            }
+            SVFOutputsSIMD out;
+            if (modulated)
+                simd.setCutoffFreqs(cutoffs);
+            simd.processAudioSample(input, out);
+            sink += out.lowpass[0];
+        }
+        std::chrono::duration<double> after = std::chrono::steady_clock::now() - start;
+
+        printf("%d lanes, %s cutoffs: scalar %.0f lanes/us, SIMD %.0f lanes/us (%.1fx)\n",
+               numLanes, modulated ? "modulated" : "fixed",
+               numLanes * numSamples / (1e6 * before.count()),
+               numLanes * numSamples / (1e6 * after.count()), before.count() / after.count());
+    }
+
+    VAStateVariableFilter scalar[numLanes];
+    VAStateVariableFilterSIMD simd;
+    for (int lane = 0; lane < numLanes; lane++) {
+        scalar[lane].setParameters(500.0f * (lane + 1), 0.1f * lane, 48000.0f);
+        simd.setCutoffFreq(lane, 500.0f * (lane + 1));
+        simd.setResonance(lane, 0.1f * lane);
+    }
+    simd.setSampleRate(48000.0f);
+    for (int i = 0; i < 100000; i++) {
+        float input[numLanes];
+        SVFOutputsSIMD out;
+        for (int lane = 0; lane < numLanes; lane++)
+            input[lane] = sinf(0.01f * i * (lane + 1));
+        simd.processAudioSample(input, out);
+        for (int lane = 0; lane < numLanes; lane++) {
+            SVFOutputs expected;
+            scalar[lane].processAudioSampleAll(input[lane], 0, expected);
+            maxError = fmax(maxError, fabs(out.lowpass[lane] - expected.lowpass));
+            maxError = fmax(maxError, fabs(out.notch[lane] - expected.notch));
+        }
+    }
+    printf("largest difference to the scalar filter: %g\n", maxError);
+    printf("(%g)\n", sink);
+    return 0;
+}
+#endif
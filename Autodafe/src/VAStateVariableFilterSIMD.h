@@ -0,0 +1,154 @@
+/*
+  ==============================================================================
+
+    VAStateVariableFilterSIMD.h
+
+    Notes:
+    The TPT state variable filter of VAStateVariableFilter.h, running several
+    independent filters ("lanes") at once: 8 with AVX, otherwise 4 with SSE.
+    Each lane has its own cutoff, resonance, shelf gain and state, stored as
+    structure of arrays so that one sample of every lane is a single vector
+    operation per filter equation. Meant for polyphonic voices and for the
+    channels of stereo-linked processing.
+
+    The per-sample division of the scalar filter is replaced by a reciprocal
+    computed with the coefficients, so the outputs can differ from
+    VAStateVariableFilter in the last bits.
+
+  ==============================================================================
+*/
+
+#ifndef VASTATEVARIABLEFILTERSIMD_H
+#define VASTATEVARIABLEFILTERSIMD_H
+
+//==============================================================================
+
+#include "VAStateVariableFilter.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SVF_SIMD_LANES 8
+typedef __m256 SVFVector;
+inline SVFVector svfLoad(const float* p) { return _mm256_loadu_ps(p); }
+inline void svfStore(float* p, SVFVector v) { _mm256_storeu_ps(p, v); }
+inline SVFVector svfAdd(SVFVector a, SVFVector b) { return _mm256_add_ps(a, b); }
+inline SVFVector svfSub(SVFVector a, SVFVector b) { return _mm256_sub_ps(a, b); }
+inline SVFVector svfMul(SVFVector a, SVFVector b) { return _mm256_mul_ps(a, b); }
+#else
+#include <xmmintrin.h>
+#define SVF_SIMD_LANES 4
+typedef __m128 SVFVector;
+inline SVFVector svfLoad(const float* p) { return _mm_loadu_ps(p); }
+inline void svfStore(float* p, SVFVector v) { _mm_storeu_ps(p, v); }
+inline SVFVector svfAdd(SVFVector a, SVFVector b) { return _mm_add_ps(a, b); }
+inline SVFVector svfSub(SVFVector a, SVFVector b) { return _mm_sub_ps(a, b); }
+inline SVFVector svfMul(SVFVector a, SVFVector b) { return _mm_mul_ps(a, b); }
+#endif
+
+//==============================================================================
+
+/** Every output type of every lane for one input sample per lane. */
+struct SVFOutputsSIMD {
+    float lowpass[SVF_SIMD_LANES];
+    float bandpass[SVF_SIMD_LANES];
+    float highpass[SVF_SIMD_LANES];
+    float unitGainBandpass[SVF_SIMD_LANES];
+    float bandShelving[SVF_SIMD_LANES];
+    float notch[SVF_SIMD_LANES];
+    float allpass[SVF_SIMD_LANES];
+    float peak[SVF_SIMD_LANES];
+};
+
+//==============================================================================
+class VAStateVariableFilterSIMD {
+public:
+    enum { numLanes = SVF_SIMD_LANES };
+
+    /** Create and initialize all lanes with the defaults of VAStateVariableFilter. */
+    VAStateVariableFilterSIMD();
+
+    //------------------------------------------------------------------------------
+    /**	Sets the sample rate of all lanes, and recalculates their coefficients. */
+    void setSampleRate(const float& newSampleRate);
+
+    //------------------------------------------------------------------------------
+    /**	Sets the cutoff (Hz) of one lane, with the exact prewarp. */
+    void setCutoffFreq(const int& lane, const float& newCutoff);
+
+    //------------------------------------------------------------------------------
+    /**	Sets the cutoff (Hz) of every lane from an array of numLanes values, with
+        the fast prewarp of VAStateVariableFilter::setCutoffFreqFast(), for
+        modulating the cutoffs on every sample.
+    */
+    void setCutoffFreqs(const float* newCutoffs);
+
+    //------------------------------------------------------------------------------
+    /**	Sets the resonance (0-1) of one lane. */
+    void setResonance(const int& lane, const float& newResonance);
+
+    //------------------------------------------------------------------------------
+    /**	Sets the resonance (0-1) of every lane from an array of numLanes values.
+        Lanes whose resonance did not change are not recalculated.
+    */
+    void setResonances(const float* newResonances);
+
+    //------------------------------------------------------------------------------
+    /**	Sets the gain of the shelf of one lane, for the bandShelving output. */
+    void setShelfGain(const int& lane, const float& newGain);
+
+    //------------------------------------------------------------------------------
+    /**	Clears the state of every lane. */
+    void reset();
+
+    //------------------------------------------------------------------------------
+    /**	Processes one sample on every lane, from an array of numLanes inputs, and
+        returns every filter type of every lane.
+    */
+    void processAudioSample(const float* input, SVFOutputsSIMD& outputs)
+    {
+        const SVFVector in = svfLoad(input);
+        const SVFVector g = svfLoad(gCoeff);
+        const SVFVector R2 = svfLoad(R2Coeff);
+        const SVFVector z1 = svfLoad(z1_A);
+        const SVFVector z2 = svfLoad(z2_A);
+
+        // Filter processing, as in VAStateVariableFilter::processAudioSample():
+        const SVFVector HP = svfMul(svfSub(svfSub(in, svfMul(svfAdd(R2, g), z1)), z2), svfLoad(HPScale));
+        const SVFVector BP = svfAdd(svfMul(HP, g), z1);
+        const SVFVector LP = svfAdd(svfMul(BP, g), z2);
+        const SVFVector UBP = svfMul(R2, BP);
+
+        svfStore(z1_A, svfAdd(svfMul(g, HP), BP));		// unit delay (state variable)
+        svfStore(z2_A, svfAdd(svfMul(g, BP), LP));		// unit delay (state variable)
+
+        svfStore(outputs.lowpass, LP);
+        svfStore(outputs.bandpass, BP);
+        svfStore(outputs.highpass, HP);
+        svfStore(outputs.unitGainBandpass, UBP);
+        svfStore(outputs.bandShelving, svfAdd(in, svfMul(UBP, svfLoad(KCoeff))));
+        svfStore(outputs.notch, svfSub(in, UBP));
+        svfStore(outputs.allpass, svfSub(in, svfAdd(UBP, UBP)));
+        svfStore(outputs.peak, svfSub(LP, HP));
+    }
+
+private:
+    //==============================================================================
+    //	Calculate the coefficients of one lane based on its parameters.
+    void calcLane(int lane);
+
+    //	Parameters:
+    float cutoffFreq[SVF_SIMD_LANES];
+    float resonance[SVF_SIMD_LANES];
+    float sampleRate;
+
+    //	Coefficients:
+    float gCoeff[SVF_SIMD_LANES];		// gain element
+    float R2Coeff[SVF_SIMD_LANES];		// twice the feedback damping element R
+    float KCoeff[SVF_SIMD_LANES];		// shelf gain element
+    float HPScale[SVF_SIMD_LANES];		// 1 / (1 + 2Rg + g^2), the zero-delay feedback solution
+
+    float z1_A[SVF_SIMD_LANES], z2_A[SVF_SIMD_LANES];		// state variables (z^-1)
+};
+
+//==============================================================================
+#endif  // VASTATEVARIABLEFILTERSIMD_H
@@ -39,8 +39,19 @@
   * Very simple WAV file writer for saving captured audio.
   */
 
+#ifdef __linux__
+#define _GNU_SOURCE /* for fallocate() */
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "write_wav.h"
 
 
@@ -75,10 +86,163 @@ static void WriteChunkType( unsigned char **addrPtr, unsigned long cktyp )
 	*addrPtr = addr;
 }
 
-#define WAV_HEADER_SIZE (4 + 4 + 4 + /* RIFF+size+WAVE */ \
-        4 + 4 + 16 + /* fmt chunk */ \
+/* Write 64 bit data to a little endian format byte array. */
+static void WriteLongLongLE( unsigned char **addrPtr, unsigned long long data )
+{
+	WriteLongLE( addrPtr, (unsigned long) (data & 0xFFFFFFFF) );
+	WriteLongLE( addrPtr, (unsigned long) (data >> 32) );
+}
+
+static unsigned long ReadLongLE( const unsigned char *addr )
+{
+    return addr[0] | (addr[1] << 8) | (addr[2] << 16) | ((unsigned long) addr[3] << 24);
+}
+
+static unsigned long long ReadLongLongLE( const unsigned char *addr )
+{
+    return ReadLongLE( addr ) | ((unsigned long long) ReadLongLE( addr + 4 ) << 32);
+}
+
+static unsigned long ReadChunkType( const unsigned char *addr )
+{
+    return ((unsigned long) addr[0] << 24) | (addr[1] << 16) | (addr[2] << 8) | addr[3];
+}
+
+/* Seek and tell with 64 bit offsets, for files past 2 GB. */
+static int SeekFile( FILE *fid, long long offset )
+{
+#ifdef _WIN32
+    return _fseeki64( fid, offset, SEEK_SET );
+#else
+    return fseeko( fid, (off_t) offset, SEEK_SET );
+#endif
+}
+
+static long long FileSize( FILE *fid )
+{
+#ifdef _WIN32
+    if( _fseeki64( fid, 0, SEEK_END ) < 0 ) return -1;
+    return _ftelli64( fid );
+#else
+    if( fseeko( fid, 0, SEEK_END ) < 0 ) return -1;
+    return ftello( fid );
+#endif
+}
+
+static int TruncateFile( FILE *fid, long long size )
+{
+    fflush( fid );
+#ifdef _WIN32
+    return _chsize_s( _fileno( fid ), size ) == 0 ? 0 : -1;
+#else
+    return ftruncate( fileno( fid ), (off_t) size );
+#endif
+}
+
+/* The ds64 chunk holds 64 bit RIFF, data and sample counts plus an empty table. */
+#define DS64_CHUNK_SIZE (8 + 8 + 8 + 4)
+
+#define WAV_MAX_HEADER_SIZE (4 + 4 + 4 + /* RIFF+size+WAVE */ \
+        4 + 4 + DS64_CHUNK_SIZE + /* JUNK chunk, becomes ds64 for RF64 */ \
+        4 + 4 + 18 + /* fmt chunk */ \
+        4 + 4 + 4 + /* fact chunk */ \
+        4 + 4 + BEXT_CHUNK_SIZE + /* bext chunk, optional */ \
         4 + 4 ) /* data chunk */
 
+/* Fails to compile if the header copy in WAV_Writer is too small. */
+typedef char WAV_HeaderCopyFits[ (WAV_MAX_HEADER_SIZE <= WAV_HEADER_MAX_SIZE) ? 1 : -1 ];
+
+/* Put the RIFF, ds64, fact and data sizes for dataSize bytes of samples, followed by trailerSize
+ * bytes of chunks, into the header copy. Files whose RIFF size does not fit in 32 bits
+ * become RF64 files, with the JUNK chunk turned into a ds64 chunk that holds the real sizes. */
+static void SetHeaderSizes( WAV_Writer *writer, unsigned long long dataSize, int trailerSize )
+{
+    unsigned char *addr;
+    unsigned long long riffSize = dataSize + (writer->headerSize - 8) + trailerSize;
+    unsigned long long numFrames = dataSize / writer->bytesPerFrame;
+    int isRF64 = (riffSize > 0xFFFFFFFFULL);
+
+    addr = writer->header;
+    WriteChunkType( &addr, isRF64 ? RF64_ID : RIFF_ID );
+    WriteLongLE( &addr, isRF64 ? 0xFFFFFFFF : (unsigned long) riffSize );
+    if( isRF64 )
+    {
+        addr = writer->header + 12;
+        WriteChunkType( &addr, DS64_ID );
+        WriteLongLE( &addr, DS64_CHUNK_SIZE );
+        WriteLongLongLE( &addr, riffSize );
+        WriteLongLongLE( &addr, dataSize );
+        WriteLongLongLE( &addr, numFrames );
+        WriteLongLE( &addr, 0 ); /* table length */
+    }
+    if( writer->factOffset > 0 )
+    {
+        addr = writer->header + writer->factOffset;
+        WriteLongLE( &addr, isRF64 ? 0xFFFFFFFF : (unsigned long) numFrames );
+    }
+    addr = writer->header + writer->dataSizeOffset;
+    WriteLongLE( &addr, isRF64 ? 0xFFFFFFFF : (unsigned long) dataSize );
+}
+
+/* Once refreshSize more bytes are on disk, write the sizes of the whole frames on disk so
+ * far with a single pwrite(), which does not move the file position of the sample writes. */
+static void RefreshHeader( WAV_Writer *writer )
+{
+#ifndef _WIN32
+    unsigned long long onDisk;
+    if( writer->refreshSize <= 0 || writer->fileOffset - writer->refreshedOffset < writer->refreshSize ) return;
+    onDisk = writer->fileOffset - writer->headerSize;
+    SetHeaderSizes( writer, onDisk - onDisk % writer->bytesPerFrame, 0 );
+    /* Best effort, as the header is written again at close. */
+    if( pwrite( fileno( writer->fid ), writer->header, writer->headerSize, 0 ) != writer->headerSize )
+    {
+        writer->refreshSize = 0;
+    }
+    writer->refreshedOffset = writer->fileOffset;
+#else
+    (void) writer;
+#endif
+}
+
+/* Reserve space for the next preallocateSize bytes once the writes get past the reserved region. */
+static void PreallocateAhead( WAV_Writer *writer, long long endOffset )
+{
+#ifdef __linux__
+    if( writer->preallocateSize > 0 && endOffset > writer->preallocatedEnd )
+    {
+        long long newEnd = endOffset + writer->preallocateSize;
+        /* Best effort: filesystems without fallocate support just grow as usual. */
+        if( fallocate( fileno( writer->fid ), FALLOC_FL_KEEP_SIZE, writer->preallocatedEnd,
+                newEnd - writer->preallocatedEnd ) == 0 )
+        {
+            writer->preallocatedEnd = newEnd;
+        }
+        else
+        {
+            writer->preallocateSize = 0;
+        }
+    }
+#else
+    (void) writer;
+    (void) endOffset;
+#endif
+}
+
+/* Write the block buffer to the file. Full buffers start at multiples of
+ * WAV_WRITE_BUFFER_SIZE because the header is written through the buffer too. */
+static long FlushBuffer( WAV_Writer *writer )
+{
+    int numWritten;
+    if( writer->bufferUsed == 0 ) return 0;
+    PreallocateAhead( writer, writer->fileOffset + writer->bufferUsed );
+    numWritten = fwrite( writer->buffer, 1, writer->bufferUsed, writer->fid );
+    if( numWritten != writer->bufferUsed ) return -1;
+    writer->fileOffset += numWritten;
+    writer->bufferUsed = 0;
+    RefreshHeader( writer );
+    return numWritten;
+}
+
 
 /*********************************************************************************
  * Open named file and write WAV header to the file.
@@ -86,20 +250,62 @@ static void WriteChunkType( unsigned char **addrPtr, unsigned long cktyp )
  * Returns number of bytes written to file or negative error code.
  */
 long Audio_WAV_OpenWriter( WAV_Writer *writer, const char *fileName, int frameRate, int samplesPerFrame )
+{
+    return Audio_WAV_OpenWriterFormat( writer, fileName, frameRate, samplesPerFrame, WAV_SAMPLE_INT16 );
+}
+
+long Audio_WAV_OpenWriterFormat( WAV_Writer *writer, const char *fileName, int frameRate, int samplesPerFrame,
+        int sampleFormat )
 {
 	unsigned int  bytesPerSecond;
-    unsigned char header[ WAV_HEADER_SIZE ];
+    unsigned char header[ WAV_MAX_HEADER_SIZE ];
 	unsigned char *addr = header;
     int numWritten;
+    int bytesPerSample;
+    int isFloat = (sampleFormat == WAV_SAMPLE_FLOAT32);
+    int i;
+
+    switch( sampleFormat )
+    {
+    case WAV_SAMPLE_INT16:   bytesPerSample = 2; break;
+    case WAV_SAMPLE_INT24:   bytesPerSample = 3; break;
+    case WAV_SAMPLE_FLOAT32: bytesPerSample = 4; break;
+    default: return WAV_ERR_ILLEGAL_VALUE;
+    }
 	
     writer->dataSize = 0;
     writer->dataSizeOffset = 0;
-	
-    writer->fid = fopen( fileName, "wb" );
+    writer->factOffset = 0;
+    writer->headerSize = 0;
+    writer->sampleFormat = sampleFormat;
+    writer->bytesPerFrame = bytesPerSample * samplesPerFrame;
+    writer->bufferUsed = 0;
+    writer->preallocateSize = 0;
+    writer->preallocatedEnd = 0;
+    writer->fileOffset = 0;
+    writer->cues = NULL;
+    writer->numCues = 0;
+    writer->isMapped = 0;
+    writer->map = NULL;
+    writer->mapOffset = 0;
+    writer->allocatedEnd = 0;
+    writer->refreshSize = 0;
+    writer->refreshedOffset = 0;
+    writer->buffer = (unsigned char *) malloc( WAV_WRITE_BUFFER_SIZE );
+    if( writer->buffer == NULL )
+    {
+        return -1;
+    }
+    /* Opened for reading too, which a shared writable mapping needs. */
+    writer->fid = fopen( fileName, "w+b" );
     if( writer->fid == NULL )
     {
+        free( writer->buffer );
+        writer->buffer = NULL;
         return -1;
     }
+    /* All writes go through our own block buffer, so stdio buffering would only add a copy. */
+    setvbuf( writer->fid, NULL, _IONBF, 0 );
 
 /* Write RIFF header. */
 	WriteChunkType( &addr, RIFF_ID );
@@ -110,16 +316,34 @@ long Audio_WAV_OpenWriter( WAV_Writer *writer, const char *fileName, int frameRa
 /* Write WAVE form ID. */
 	WriteChunkType( &addr, WAVE_ID );
 
+/* Reserve room for a ds64 chunk in case the file outgrows 32 bit sizes. */
+	WriteChunkType( &addr, JUNK_ID );
+    WriteLongLE( &addr, DS64_CHUNK_SIZE );
+    for( i=0; i<DS64_CHUNK_SIZE; i++ )
+    {
+        *addr++ = 0;
+    }
+
 /* Write format chunk based on AudioSample structure. */
 	WriteChunkType( &addr, FMT_ID );
-    WriteLongLE( &addr, 16 );
-    WriteShortLE( &addr, WAVE_FORMAT_PCM );
-		bytesPerSecond = frameRate * samplesPerFrame * sizeof( short);
+    WriteLongLE( &addr, isFloat ? 18 : 16 );
+    WriteShortLE( &addr, isFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM );
+		bytesPerSecond = frameRate * samplesPerFrame * bytesPerSample;
 	WriteShortLE( &addr, (short) samplesPerFrame );
 	WriteLongLE( &addr, frameRate );
 	WriteLongLE( &addr,  bytesPerSecond );
-	WriteShortLE( &addr, (short) (samplesPerFrame * sizeof( short)) ); /* bytesPerBlock */
-	WriteShortLE( &addr, (short) 16 ); /* bits per sample */
+	WriteShortLE( &addr, (short) (samplesPerFrame * bytesPerSample) ); /* bytesPerBlock */
+	WriteShortLE( &addr, (short) (8 * bytesPerSample) ); /* bits per sample */
+    if( isFloat )
+    {
+        WriteShortLE( &addr, 0 ); /* cbSize */
+
+/* Non-PCM formats need a fact chunk with the number of sample frames. */
+        WriteChunkType( &addr, FACT_ID );
+        WriteLongLE( &addr, 4 );
+        writer->factOffset = (int) (addr - header);
+        WriteLongLE( &addr, 0 );
+    }
 
 /* Write ID and size for 'data' chunk. */
 	WriteChunkType( &addr, DATA_ID );
@@ -127,12 +351,155 @@ long Audio_WAV_OpenWriter( WAV_Writer *writer, const char *fileName, int frameRa
     writer->dataSizeOffset = (int) (addr - header);
 	WriteLongLE( &addr, 0 );
 
-    numWritten = fwrite( header, 1, sizeof(header), writer->fid );
-    if( numWritten != sizeof(header) ) return -1;
+    /* The header goes out with the first block of samples. */
+    writer->headerSize = (int) (addr - header);
+    memcpy( writer->header, header, writer->headerSize );
+    memcpy( writer->buffer, header, writer->headerSize );
+    writer->bufferUsed = writer->headerSize;
+    numWritten = writer->headerSize;
 
 	return (int) numWritten;
 }
 
+long Audio_WAV_SetPreallocation( WAV_Writer *writer, long numBytes )
+{
+    writer->preallocateSize = (numBytes > 0) ? numBytes : 0;
+    return 0;
+}
+
+/* Copies a string into a fixed size field, padded with zeros. */
+static void WriteStringField( unsigned char **addrPtr, const char *text, int size )
+{
+    int i;
+    for( i=0; i<size; i++ )
+    {
+        *(*addrPtr)++ = (text != NULL && *text) ? (unsigned char) *text++ : 0;
+    }
+}
+
+long Audio_WAV_SetBroadcastInfo( WAV_Writer *writer, const char *description, const char *originator,
+        const char *originationDate, const char *originationTime, unsigned long long timeReference )
+{
+    unsigned char *addr;
+    int dataChunkOffset;
+
+    /* The header must still be in the buffer, and have no bext chunk yet. */
+    if( writer->fileOffset > 0 || writer->bufferUsed != writer->headerSize ||
+        writer->headerSize + 8 + BEXT_CHUNK_SIZE > WAV_HEADER_MAX_SIZE ) return WAV_ERR_ILLEGAL_VALUE;
+
+    /* The bext chunk goes where the data chunk header was, which moves behind it. */
+    dataChunkOffset = writer->dataSizeOffset - 4;
+    addr = writer->header + dataChunkOffset;
+    WriteChunkType( &addr, BEXT_ID );
+    WriteLongLE( &addr, BEXT_CHUNK_SIZE );
+    WriteStringField( &addr, description, 256 );
+    WriteStringField( &addr, originator, 32 );
+    WriteStringField( &addr, NULL, 32 ); /* OriginatorReference */
+    WriteStringField( &addr, originationDate, 10 );
+    WriteStringField( &addr, originationTime, 8 );
+    WriteLongLE( &addr, (unsigned long) (timeReference & 0xFFFFFFFF) );
+    WriteLongLE( &addr, (unsigned long) (timeReference >> 32) );
+    WriteShortLE( &addr, 1 ); /* Version */
+    WriteStringField( &addr, NULL, 64 + 190 ); /* UMID and reserved */
+
+    WriteChunkType( &addr, DATA_ID );
+    writer->dataSizeOffset = (int) (addr - writer->header);
+    WriteLongLE( &addr, 0 );
+
+    writer->headerSize = (int) (addr - writer->header);
+    memcpy( writer->buffer, writer->header, writer->headerSize );
+    writer->bufferUsed = writer->headerSize;
+    return 0;
+}
+
+long Audio_WAV_SetHeaderRefresh( WAV_Writer *writer, long numBytes )
+{
+    writer->refreshSize = (numBytes > 0) ? numBytes : 0;
+    return 0;
+}
+
+long Audio_WAV_SetMemoryMapped( WAV_Writer *writer )
+{
+#ifdef __linux__
+    /* The header goes out through the file, the samples through the map behind it. */
+    if( writer->dataSize > 0 ) return WAV_ERR_ILLEGAL_VALUE;
+    if( FlushBuffer( writer ) < 0 ) return -1;
+    writer->preallocateSize = 0;
+    writer->allocatedEnd = writer->fileOffset;
+    writer->isMapped = 1;
+    return 0;
+#else
+    (void) writer;
+    return -1;
+#endif
+}
+
+unsigned char *Audio_WAV_BeginWrite( WAV_Writer *writer, long numBytes )
+{
+#ifdef __linux__
+    if( !writer->isMapped || numBytes <= 0 || numBytes > WAV_MAP_WINDOW_SIZE / 2 ) return NULL;
+    if( writer->map == NULL || writer->fileOffset + numBytes > writer->mapOffset + WAV_MAP_WINDOW_SIZE )
+    {
+        /* Move the window up to the page that holds the write position. */
+        long long pageSize = sysconf( _SC_PAGESIZE );
+        long long start = writer->fileOffset & ~(pageSize - 1);
+        long long end = start + WAV_MAP_WINDOW_SIZE;
+        void *map;
+        if( writer->map != NULL )
+        {
+            munmap( writer->map, WAV_MAP_WINDOW_SIZE );
+            writer->map = NULL;
+        }
+        /* Writing to a mapped page without disk space behind it would raise SIGBUS, so
+         * the space is allocated first. That also grows the file up to the window end. */
+        if( end > writer->allocatedEnd )
+        {
+            if( posix_fallocate( fileno( writer->fid ), writer->allocatedEnd, end - writer->allocatedEnd ) != 0 ) return NULL;
+            writer->allocatedEnd = end;
+        }
+        map = mmap( NULL, WAV_MAP_WINDOW_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fileno( writer->fid ), start );
+        if( map == MAP_FAILED ) return NULL;
+        writer->map = (unsigned char *) map;
+        writer->mapOffset = start;
+    }
+    return writer->map + (writer->fileOffset - writer->mapOffset);
+#else
+    (void) writer;
+    (void) numBytes;
+    return NULL;
+#endif
+}
+
+long Audio_WAV_EndWrite( WAV_Writer *writer, long numBytes )
+{
+    if( !writer->isMapped || writer->map == NULL || numBytes < 0 ||
+        writer->fileOffset + numBytes > writer->mapOffset + WAV_MAP_WINDOW_SIZE ) return WAV_ERR_ILLEGAL_VALUE;
+    writer->fileOffset += numBytes;
+    writer->dataSize += numBytes;
+    /* Mapped pages survive a crash of the process, like data that went through write(). */
+    RefreshHeader( writer );
+    return numBytes;
+}
+
+/* Unmap the window and cut the file back to the end of the data, so that the chunks after
+ * the data and the header patches can go through the FILE again. */
+static long UnmapFile( WAV_Writer *writer )
+{
+#ifdef __linux__
+    if( writer->map != NULL )
+    {
+        munmap( writer->map, WAV_MAP_WINDOW_SIZE );
+        writer->map = NULL;
+    }
+    writer->isMapped = 0;
+    if( ftruncate( fileno( writer->fid ), writer->fileOffset ) < 0 ) return -1;
+    if( fseek( writer->fid, writer->fileOffset, SEEK_SET ) < 0 ) return -1;
+#else
+    (void) writer;
+#endif
+    return 0;
+}
+
 /*********************************************************************************
  * Write to the data chunk portion of a WAV file.
  * Returns bytes written or negative error code.
@@ -142,62 +509,366 @@ long Audio_WAV_WriteShorts( WAV_Writer *writer,
 		int numSamples
 		)
 {
-	unsigned char buffer[2];
     unsigned char *bufferPtr;
 	int i;
 	short *p = samples;
-    int numWritten;
+    int numLeft = numSamples;
     int bytesWritten;
-	if( numSamples <= 0 )
+	if( numSamples <= 0 || writer->sampleFormat != WAV_SAMPLE_INT16 )
 	{
 		return -1;
 	}
 
-    for( i=0; i<numSamples; i++ )
-	{
-        bufferPtr = buffer;
-		WriteShortLE( &bufferPtr, *p++ );
-        numWritten = fwrite( buffer, 1, sizeof( buffer), writer->fid );
-        if( numWritten != sizeof(buffer) ) return -1;
-	}
+    /* Serialize straight into the file pages. */
+    while( writer->isMapped && numLeft > 0 )
+    {
+        int n = (numLeft < WAV_WRITE_BUFFER_SIZE / 2) ? numLeft : WAV_WRITE_BUFFER_SIZE / 2;
+        bufferPtr = Audio_WAV_BeginWrite( writer, n * sizeof(short) );
+        if( bufferPtr == NULL ) return -1;
+        for( i=0; i<n; i++ )
+        {
+            WriteShortLE( &bufferPtr, *p++ );
+        }
+        Audio_WAV_EndWrite( writer, n * sizeof(short) );
+        numLeft -= n;
+        if( numLeft == 0 ) return numSamples * sizeof(short);
+    }
+
+    while( numLeft > 0 )
+    {
+        /* Serialize as many samples as fit, then write the block once it is full. */
+        int numFit = (WAV_WRITE_BUFFER_SIZE - writer->bufferUsed) / (int) sizeof(short);
+        int n = (numLeft < numFit) ? numLeft : numFit;
+        bufferPtr = writer->buffer + writer->bufferUsed;
+        for( i=0; i<n; i++ )
+        {
+            WriteShortLE( &bufferPtr, *p++ );
+        }
+        writer->bufferUsed += n * sizeof(short);
+        numLeft -= n;
+        if( writer->bufferUsed == WAV_WRITE_BUFFER_SIZE )
+        {
+            if( FlushBuffer( writer ) < 0 ) return -1;
+        }
+    }
     bytesWritten = numSamples * sizeof(short);
     writer->dataSize += bytesWritten;
 	return (int) bytesWritten;
 }
 
+long Audio_WAV_WriteBytes( WAV_Writer *writer,
+		const void *data,
+		long numBytes
+		)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    long numLeft = numBytes;
+	if( numBytes <= 0 )
+	{
+		return -1;
+	}
+
+    while( writer->isMapped && numLeft > 0 )
+    {
+        long n = (numLeft < WAV_WRITE_BUFFER_SIZE) ? numLeft : WAV_WRITE_BUFFER_SIZE;
+        unsigned char *dest = Audio_WAV_BeginWrite( writer, n );
+        if( dest == NULL ) return -1;
+        memcpy( dest, p, n );
+        Audio_WAV_EndWrite( writer, n );
+        p += n;
+        numLeft -= n;
+        if( numLeft == 0 ) return numBytes;
+    }
+
+    while( numLeft > 0 )
+    {
+        long numFit = WAV_WRITE_BUFFER_SIZE - writer->bufferUsed;
+        long n = (numLeft < numFit) ? numLeft : numFit;
+        memcpy( writer->buffer + writer->bufferUsed, p, n );
+        writer->bufferUsed += (int) n;
+        p += n;
+        numLeft -= n;
+        if( writer->bufferUsed == WAV_WRITE_BUFFER_SIZE )
+        {
+            if( FlushBuffer( writer ) < 0 ) return -1;
+        }
+    }
+    writer->dataSize += numBytes;
+	return numBytes;
+}
+
+long Audio_WAV_AddCue( WAV_Writer *writer, unsigned long long frame, const char *label )
+{
+    WAV_Cue *cue;
+    if( frame > 0xFFFFFFFFULL ) return WAV_ERR_ILLEGAL_VALUE;
+    if( writer->numCues >= WAV_MAX_CUES ) return -1;
+    if( writer->cues == NULL )
+    {
+        writer->cues = (WAV_Cue *) malloc( WAV_MAX_CUES * sizeof(WAV_Cue) );
+        if( writer->cues == NULL ) return -1;
+    }
+    cue = &writer->cues[ writer->numCues++ ];
+    cue->frame = (unsigned long) frame;
+    strncpy( cue->label, label ? label : "", WAV_CUE_LABEL_SIZE - 1 );
+    cue->label[ WAV_CUE_LABEL_SIZE - 1 ] = 0;
+    return 0;
+}
+
+/* Serialize the cue chunk and a LIST/adtl chunk with the cue labels into the block buffer.
+ * WAV_MAX_CUES is small enough for all of it to fit into one block. */
+static int WriteCueChunks( WAV_Writer *writer )
+{
+    unsigned char *start = writer->buffer + writer->bufferUsed;
+    unsigned char *addr = start;
+    unsigned long listSize = 4;
+    int i;
+
+    if( writer->numCues == 0 ) return 0;
+
+    WriteChunkType( &addr, CUE_ID );
+    WriteLongLE( &addr, 4 + 24 * writer->numCues );
+    WriteLongLE( &addr, writer->numCues );
+    for( i=0; i<writer->numCues; i++ )
+    {
+        WriteLongLE( &addr, i + 1 ); /* cue point ID */
+        WriteLongLE( &addr, writer->cues[i].frame ); /* play order position */
+        WriteChunkType( &addr, DATA_ID );
+        WriteLongLE( &addr, 0 ); /* chunk start */
+        WriteLongLE( &addr, 0 ); /* block start */
+        WriteLongLE( &addr, writer->cues[i].frame ); /* sample offset */
+    }
+
+    for( i=0; i<writer->numCues; i++ )
+    {
+        int labelSize = 4 + (int) strlen( writer->cues[i].label ) + 1;
+        listSize += 8 + labelSize + (labelSize & 1);
+    }
+    WriteChunkType( &addr, LIST_ID );
+    WriteLongLE( &addr, listSize );
+    WriteChunkType( &addr, ADTL_ID );
+    for( i=0; i<writer->numCues; i++ )
+    {
+        int length = (int) strlen( writer->cues[i].label ) + 1;
+        WriteChunkType( &addr, LABL_ID );
+        WriteLongLE( &addr, 4 + length );
+        WriteLongLE( &addr, i + 1 );
+        memcpy( addr, writer->cues[i].label, length );
+        addr += length;
+        if( (4 + length) & 1 )
+        {
+            *addr++ = 0;
+        }
+    }
+
+    writer->bufferUsed += (int) (addr - start);
+    return (int) (addr - start);
+}
+
+/* Overwrite numBytes at a given file offset. */
+static long PatchBytes( WAV_Writer *writer, long offset, const unsigned char *bytes, int numBytes )
+{
+    int result = fseek( writer->fid, offset, SEEK_SET );
+    if( result < 0 ) return result;
+    if( (int) fwrite( bytes, 1, numBytes, writer->fid ) != numBytes ) return -1;
+    return 0;
+}
+
 /*********************************************************************************
  * Close WAV file.
  * Update chunk sizes so it can be read by audio applications.
+ * Files whose RIFF size does not fit in 32 bits are turned into RF64 files.
  */
 long Audio_WAV_CloseWriter( WAV_Writer *writer )
 {
-	unsigned char buffer[4];
+    int trailerSize;
+    long result;
+
+    /* Write out the last partial block, then the chunks that follow the data. */
+    result = writer->isMapped ? UnmapFile( writer ) : FlushBuffer( writer );
+    trailerSize = 0;
+    if( result >= 0 )
+    {
+        /* Pad the data chunk to an even size, whether or not chunks follow it. */
+        if( writer->dataSize & 1 )
+        {
+            writer->buffer[ writer->bufferUsed++ ] = 0;
+            trailerSize = 1;
+        }
+        trailerSize += WriteCueChunks( writer );
+        result = FlushBuffer( writer );
+    }
+    free( writer->buffer );
+    writer->buffer = NULL;
+    free( writer->cues );
+    writer->cues = NULL;
+
+#ifdef __linux__
+    /* Release space reserved past the end of the data. */
+    if( result >= 0 && writer->preallocatedEnd > writer->fileOffset )
+    {
+        if( ftruncate( fileno( writer->fid ), writer->fileOffset ) < 0 ) result = -1;
+    }
+#endif
+
+    /* Update the RIFF, ds64, fact and data sizes with one write of the header. */
+    if( result >= 0 )
+    {
+        SetHeaderSizes( writer, writer->dataSize, trailerSize );
+        result = PatchBytes( writer, 0, writer->header, writer->headerSize );
+    }
+
+    /* Close the file whatever failed, and report the first error. */
+    if( fclose( writer->fid ) != 0 && result >= 0 ) result = -1;
+    writer->fid = NULL;
+    return result < 0 ? result : 0;
+}
+
+long Audio_WAV_RepairFile( const char *fileName, unsigned long long *dataSizePtr )
+{
+    FILE *fid;
+    unsigned char buffer[ 4096 ];
     unsigned char *bufferPtr;
-    int numWritten;
-    int riffSize;
+    long long fileSize, pos;
+    long long junkOffset = 0, factOffset = 0, dataOffset = 0;
+    unsigned long long riffSize, dataSize = 0, ds64DataSize = 0, knownSize, numFrames;
+    unsigned long chunkID, chunkSize;
+    int blockAlign = 0;
+    int isRF64;
+    long result = 1;
 
-    /* Go back to beginning of file and update DATA size */
-    int result = fseek( writer->fid, writer->dataSizeOffset, SEEK_SET );
-    if( result < 0 ) return result;
+    fid = fopen( fileName, "r+b" );
+    if( fid == NULL ) return -1;
+    fileSize = FileSize( fid );
+    if( fileSize < 0 || SeekFile( fid, 0 ) < 0 ) goto ioError;
+    if( fread( buffer, 1, 12, fid ) != 12 ) { result = WAV_ERR_TRUNCATED; goto done; }
+    isRF64 = (ReadChunkType( buffer ) == RF64_ID);
+    if( (ReadChunkType( buffer ) != RIFF_ID && !isRF64) || ReadChunkType( buffer + 8 ) != WAVE_ID )
+    {
+        result = WAV_ERR_FILE_TYPE;
+        goto done;
+    }
+    riffSize = ReadLongLE( buffer + 4 );
 
-    bufferPtr = buffer;
-    WriteLongLE( &bufferPtr, writer->dataSize );
-    numWritten = fwrite( buffer, 1, sizeof( buffer), writer->fid );
-    if( numWritten != sizeof(buffer) ) return -1;
+    /* Walk the chunks up to the data chunk, whose size is the one that may be wrong. */
+    pos = 12;
+    while( dataOffset == 0 )
+    {
+        if( pos + 8 > fileSize || SeekFile( fid, pos ) < 0 || fread( buffer, 1, 8, fid ) != 8 )
+        {
+            result = WAV_ERR_TRUNCATED;
+            goto done;
+        }
+        chunkID = ReadChunkType( buffer );
+        chunkSize = ReadLongLE( buffer + 4 );
+        if( chunkID == DATA_ID )
+        {
+            dataOffset = pos + 8;
+            dataSize = chunkSize;
+            break;
+        }
+        if( pos + 8 + (long long) chunkSize > fileSize ) { result = WAV_ERR_CHUNK_SIZE; goto done; }
+        if( chunkID == FMT_ID && chunkSize >= 16 )
+        {
+            if( fread( buffer, 1, 16, fid ) != 16 ) goto ioError;
+            blockAlign = buffer[12] | (buffer[13] << 8);
+        }
+        else if( (chunkID == JUNK_ID || chunkID == DS64_ID) && chunkSize >= DS64_CHUNK_SIZE )
+        {
+            junkOffset = pos;
+            if( chunkID == DS64_ID && isRF64 )
+            {
+                if( fread( buffer, 1, 16, fid ) != 16 ) goto ioError;
+                riffSize = ReadLongLongLE( buffer );
+                ds64DataSize = ReadLongLongLE( buffer + 8 );
+            }
+        }
+        else if( chunkID == FACT_ID && chunkSize >= 4 )
+        {
+            factOffset = pos + 8;
+        }
+        pos += 8 + chunkSize + (chunkSize & 1);
+    }
+    if( blockAlign <= 0 ) { result = WAV_ERR_FORMAT_TYPE; goto done; }
+    if( isRF64 && dataSize == 0xFFFFFFFF ) dataSize = ds64DataSize;
 
-    /* Update RIFF size */
-    result = fseek( writer->fid, 4, SEEK_SET );
-    if( result < 0 ) return result;
+    /* A file that was closed ends where its RIFF chunk ends. */
+    if( riffSize + 8 >= (unsigned long long) fileSize && dataOffset + dataSize <= (unsigned long long) fileSize )
+    {
+        result = 0;
+        goto done;
+    }
+
+    /* Take all whole frames up to the end of the file, less the trailing zeros past the
+     * size in the header. The header refresh only writes sizes that are on disk, so the
+     * samples up to there are kept even if they are silent. The zeros past it are the
+     * allocated but unwritten space of memory mapped writers; buffered writers
+     * preallocate without growing the file, and leave none. */
+    knownSize = dataSize;
+    dataSize = fileSize - dataOffset;
+    dataSize -= dataSize % blockAlign;
+    if( knownSize > dataSize ) knownSize = dataSize;
+    knownSize -= knownSize % blockAlign;
+    while( dataSize > knownSize )
+    {
+        unsigned long long numLeft = dataSize - knownSize;
+        long numBytes = (long) (numLeft < sizeof(buffer) ? numLeft : sizeof(buffer));
+        long i;
+        if( SeekFile( fid, dataOffset + dataSize - numBytes ) < 0 ||
+            fread( buffer, 1, numBytes, fid ) != (size_t) numBytes ) goto ioError;
+        for( i = numBytes; i > 0 && buffer[i - 1] == 0; i-- ) {}
+        if( i > 0 )
+        {
+            dataSize -= numBytes - i;
+            dataSize += (blockAlign - dataSize % blockAlign) % blockAlign;
+            break;
+        }
+        dataSize -= numBytes;
+    }
 
-    riffSize = writer->dataSize + (WAV_HEADER_SIZE - 8);
+    /* Without room for a ds64 chunk the file has to fit a RIFF header. */
+    riffSize = dataOffset - 8 + dataSize + (dataSize & 1);
+    if( riffSize > 0xFFFFFFFFULL && junkOffset == 0 )
+    {
+        dataSize = 0xFFFFFFFEULL - (dataOffset - 8);
+        dataSize -= dataSize % blockAlign;
+        riffSize = dataOffset - 8 + dataSize + (dataSize & 1);
+    }
+    isRF64 = (riffSize > 0xFFFFFFFFULL);
+    numFrames = dataSize / blockAlign;
+    if( TruncateFile( fid, dataOffset + dataSize + (dataSize & 1) ) < 0 ) goto ioError;
+
+    bufferPtr = buffer;
+    WriteChunkType( &bufferPtr, isRF64 ? RF64_ID : RIFF_ID );
+    WriteLongLE( &bufferPtr, isRF64 ? 0xFFFFFFFF : (unsigned long) riffSize );
+    if( SeekFile( fid, 0 ) < 0 || fwrite( buffer, 1, 8, fid ) != 8 ) goto ioError;
+    if( isRF64 )
+    {
+        bufferPtr = buffer;
+        WriteChunkType( &bufferPtr, DS64_ID );
+        WriteLongLE( &bufferPtr, DS64_CHUNK_SIZE );
+        WriteLongLongLE( &bufferPtr, riffSize );
+        WriteLongLongLE( &bufferPtr, dataSize );
+        WriteLongLongLE( &bufferPtr, numFrames );
+        WriteLongLE( &bufferPtr, 0 ); /* table length */
+        if( SeekFile( fid, junkOffset ) < 0 || fwrite( buffer, 1, 8 + DS64_CHUNK_SIZE, fid ) != 8 + DS64_CHUNK_SIZE ) goto ioError;
+    }
+    if( factOffset > 0 )
+    {
+        bufferPtr = buffer;
+        WriteLongLE( &bufferPtr, isRF64 ? 0xFFFFFFFF : (unsigned long) numFrames );
+        if( SeekFile( fid, factOffset ) < 0 || fwrite( buffer, 1, 4, fid ) != 4 ) goto ioError;
+    }
     bufferPtr = buffer;
-    WriteLongLE( &bufferPtr, riffSize );
-    numWritten = fwrite( buffer, 1, sizeof( buffer), writer->fid );
-    if( numWritten != sizeof(buffer) ) return -1;
+    WriteLongLE( &bufferPtr, isRF64 ? 0xFFFFFFFF : (unsigned long) dataSize );
+    if( SeekFile( fid, dataOffset - 4 ) < 0 || fwrite( buffer, 1, 4, fid ) != 4 ) goto ioError;
+    goto done;
 
-    fclose( writer->fid );
-    writer->fid = NULL;
-    return writer->dataSize;
+ioError:
+    result = -1;
+done:
+    if( fclose( fid ) != 0 && result >= 0 ) result = -1;
+    if( result >= 0 && dataSizePtr != NULL ) *dataSizePtr = dataSize;
+    return result;
 }
 
 /*********************************************************************************
@@ -240,3 +911,129 @@ error:
     return result;
 }
 #endif
+
+/*********************************************************************************
+ * Throughput benchmark: the original one-fwrite-per-sample path against the
+ * block buffered Audio_WAV_WriteShorts(), the same with a header refresh every
+ * megabyte and the memory mapped writer, for 2, 8 and 32 channels. The mapped
+ * writer serializes straight into the file pages.
+ * Reports MB/s of sample data and CPU time as a percentage of wall time.
+ */
+#if 0
+#include <time.h>
+
+/* The old writer, on its own stream with the default stdio buffer: a 44 byte header
+ * whose sizes are patched on close, and one fwrite per sample. */
+static FILE *OpenPerSample( const char *fileName )
+{
+    unsigned char header[44];
+    FILE *fid = fopen( fileName, "wb" );
+    if( fid == NULL ) return NULL;
+    /* Before any I/O on the stream, as setvbuf() requires. */
+    setvbuf( fid, NULL, _IOFBF, BUFSIZ );
+    memset( header, 0, sizeof(header) );
+    if( fwrite( header, 1, sizeof(header), fid ) != sizeof(header) )
+    {
+        fclose( fid );
+        return NULL;
+    }
+    return fid;
+}
+
+static long WriteShortsPerSample( FILE *fid, short *samples, int numSamples )
+{
+    unsigned char buffer[2];
+    unsigned char *bufferPtr;
+    int i;
+    for( i=0; i<numSamples; i++ )
+    {
+        bufferPtr = buffer;
+        WriteShortLE( &bufferPtr, samples[i] );
+        if( fwrite( buffer, 1, sizeof( buffer), fid ) != sizeof(buffer) ) return -1;
+    }
+    return numSamples * sizeof(short);
+}
+
+static long ClosePerSample( FILE *fid, unsigned long dataSize )
+{
+    unsigned char size[4];
+    unsigned char *sizePtr;
+    long result = 0;
+    sizePtr = size;
+    WriteLongLE( &sizePtr, dataSize + 36 );
+    if( fseek( fid, 4, SEEK_SET ) < 0 || fwrite( size, 1, 4, fid ) != 4 ) result = -1;
+    sizePtr = size;
+    WriteLongLE( &sizePtr, dataSize );
+    if( fseek( fid, 40, SEEK_SET ) < 0 || fwrite( size, 1, 4, fid ) != 4 ) result = -1;
+    if( fclose( fid ) != 0 ) result = -1;
+    return result;
+}
+
+static double WallSeconds( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main( void )
+{
+#define BENCH_FRAMES_PER_CALL  (16384)
+#define BENCH_SECONDS          (60)
+#define BENCH_FRAME_RATE       (48000)
+    static short data[32 * BENCH_FRAMES_PER_CALL];
+    const int channelCounts[] = { 2, 8, 32 };
+    const char *pathNames[] = { "per-sample", "buffered", "refreshed", "mapped" };
+    int c, path, i;
+
+    for( i=0; i<32 * BENCH_FRAMES_PER_CALL; i++ )
+    {
+        data[i] = (short) (i * 293);
+    }
+
+    for( c=0; c<3; c++ )
+    {
+        for( path=0; path<4; path++ )
+        {
+            WAV_Writer writer;
+            FILE *fid = NULL;
+            int numChannels = channelCounts[c];
+            int numCalls = BENCH_SECONDS * BENCH_FRAME_RATE / BENCH_FRAMES_PER_CALL;
+            double wall, cpu, megabytes;
+            clock_t cpuStart;
+            double wallStart;
+
+            if( path == 0 )
+            {
+                fid = OpenPerSample( "bench.wav" );
+                if( fid == NULL ) return 1;
+            }
+            else if( Audio_WAV_OpenWriter( &writer, "bench.wav", BENCH_FRAME_RATE, numChannels ) < 0 ) return 1;
+            if( path == 2 ) Audio_WAV_SetHeaderRefresh( &writer, 1024 * 1024 );
+            if( path == 3 && Audio_WAV_SetMemoryMapped( &writer ) < 0 ) return 1;
+            wallStart = WallSeconds();
+            cpuStart = clock();
+            for( i=0; i<numCalls; i++ )
+            {
+                long result = (path == 0) ?
+                    WriteShortsPerSample( fid, data, numChannels * BENCH_FRAMES_PER_CALL ) :
+                    Audio_WAV_WriteShorts( &writer, data, numChannels * BENCH_FRAMES_PER_CALL );
+                if( result < 0 ) return 1;
+            }
+            if( path == 0 )
+            {
+                if( ClosePerSample( fid, (unsigned long) numCalls * numChannels * BENCH_FRAMES_PER_CALL * sizeof(short) ) < 0 ) return 1;
+            }
+            else if( Audio_WAV_CloseWriter( &writer ) < 0 ) return 1;
+            wall = WallSeconds() - wallStart;
+            cpu = (double) (clock() - cpuStart) / CLOCKS_PER_SEC;
+            megabytes = (double) numCalls * numChannels * BENCH_FRAMES_PER_CALL * sizeof(short) / (1024 * 1024);
+
+            printf( "%2d channels, %-9s %8.1f MB/s, CPU %5.1f%%\n", numChannels,
+                    pathNames[path], megabytes / wall, 100.0 * cpu / wall );
+        }
+    }
+    remove( "bench.wav" );
+    return 0;
+}
+#endif
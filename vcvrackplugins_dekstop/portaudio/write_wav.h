@@ -53,6 +53,14 @@ extern "C" {
 #define FMT_ID    (('f'<<24) | ('m'<<16) | ('t'<<8) | ' ')
 #define DATA_ID   (('d'<<24) | ('a'<<16) | ('t'<<8) | 'a')
 #define FACT_ID   (('f'<<24) | ('a'<<16) | ('c'<<8) | 't')
+#define JUNK_ID   (('J'<<24) | ('U'<<16) | ('N'<<8) | 'K')
+#define RF64_ID   (('R'<<24) | ('F'<<16) | ('6'<<8) | '4')
+#define DS64_ID   (('d'<<24) | ('s'<<16) | ('6'<<8) | '4')
+#define CUE_ID    (('c'<<24) | ('u'<<16) | ('e'<<8) | ' ')
+#define LIST_ID   (('L'<<24) | ('I'<<16) | ('S'<<8) | 'T')
+#define ADTL_ID   (('a'<<24) | ('d'<<16) | ('t'<<8) | 'l')
+#define LABL_ID   (('l'<<24) | ('a'<<16) | ('b'<<8) | 'l')
+#define BEXT_ID   (('b'<<24) | ('e'<<16) | ('x'<<8) | 't')
 
 /* Errors returned by Audio_ParseSampleImage_WAV */
 #define WAV_ERR_CHUNK_SIZE     (-1)   /* Chunk size is illegal or past file size. */
@@ -63,15 +71,68 @@ extern "C" {
 
 /* WAV PCM data format ID */
 #define WAVE_FORMAT_PCM        (1)
+#define WAVE_FORMAT_IEEE_FLOAT (0x0003)
 #define WAVE_FORMAT_IMA_ADPCM  (0x0011)
 
+/* Sample formats for Audio_WAV_OpenWriterFormat */
+#define WAV_SAMPLE_INT16       (0)   /* 16 bit PCM */
+#define WAV_SAMPLE_INT24       (1)   /* 24 bit PCM, packed */
+#define WAV_SAMPLE_FLOAT32     (2)   /* 32 bit IEEE float */
+
 	
+/* Size of the block buffer used to batch writes. A multiple of common disk block sizes. */
+#define WAV_WRITE_BUFFER_SIZE  (256 * 1024)
+
+/* Broadcast WAV extension chunk, version 1, without coding history. */
+#define BEXT_CHUNK_SIZE        (602)
+
+/* Room for the largest header Audio_WAV_OpenWriterFormat and Audio_WAV_SetBroadcastInfo write. */
+#define WAV_HEADER_MAX_SIZE    (96 + 8 + BEXT_CHUNK_SIZE)
+
+/* Memory mapped writers map this much of the file at a time, and grow the file by as much. */
+#define WAV_MAP_WINDOW_SIZE    (16 * 1024 * 1024)
+
+/* Cue points are kept in memory until the file is closed. Further cues are ignored. */
+#define WAV_MAX_CUES           (1024)
+#define WAV_CUE_LABEL_SIZE     (48)   /* including the terminating zero */
+
+typedef struct WAV_Cue_s
+{
+    unsigned long frame;
+    char label[ WAV_CUE_LABEL_SIZE ];
+} WAV_Cue;
+
 typedef struct WAV_Writer_s
 {
     FILE *fid;
     /* Offset in file for data size. */
     int   dataSizeOffset;
-    int   dataSize;
+    /* Offset in file for the fact chunk sample count, or 0 if there is none. */
+    int   factOffset;
+    int   headerSize;
+    /* Copy of the header, with the sizes of the last update. */
+    unsigned char header[ WAV_HEADER_MAX_SIZE ];
+    unsigned long long dataSize;
+    int   sampleFormat;
+    int   bytesPerFrame;
+    /* Samples are serialized here and written in whole blocks. */
+    unsigned char *buffer;
+    int   bufferUsed;
+    /* File space is reserved ahead of the write position in steps of this many bytes, if > 0. */
+    long  preallocateSize;
+    long long preallocatedEnd;
+    long long fileOffset;
+    /* Written as cue and LIST/adtl chunks after the data when the file is closed. */
+    WAV_Cue *cues;
+    int   numCues;
+    /* Memory mapped mode: samples go straight into a mapped window of the file at fileOffset. */
+    int   isMapped;
+    unsigned char *map;
+    long long mapOffset;
+    long long allocatedEnd;
+    /* The header sizes are brought up to date every refreshSize bytes of data on disk, if > 0. */
+    long  refreshSize;
+    long long refreshedOffset;
 } WAV_Writer;
 
 /*********************************************************************************
@@ -82,7 +143,15 @@ typedef struct WAV_Writer_s
 long Audio_WAV_OpenWriter( WAV_Writer *writer, const char *fileName, int frameRate, int samplesPerFrame );
 
 /*********************************************************************************
- * Write to the data chunk portion of a WAV file.
+ * Like Audio_WAV_OpenWriter, for one of the WAV_SAMPLE_* formats.
+ * A ds64-sized JUNK chunk is reserved in the header so that recordings larger
+ * than 4 GB can be turned into RF64 files when they are closed.
+ */
+long Audio_WAV_OpenWriterFormat( WAV_Writer *writer, const char *fileName, int frameRate, int samplesPerFrame,
+        int sampleFormat );
+
+/*********************************************************************************
+ * Write to the data chunk portion of a WAV_SAMPLE_INT16 file.
  * Returns bytes written or negative error code.
  */
 long Audio_WAV_WriteShorts( WAV_Writer *writer,
@@ -90,9 +159,96 @@ long Audio_WAV_WriteShorts( WAV_Writer *writer,
 		int numSamples
 		);
 
+/*********************************************************************************
+ * Write samples that are already in the file's sample format and little endian
+ * byte order to the data chunk portion of a WAV file.
+ * Returns bytes written or negative error code.
+ */
+long Audio_WAV_WriteBytes( WAV_Writer *writer,
+		const void *data,
+		long numBytes
+		);
+
+/*********************************************************************************
+ * Reserve file space ahead of the write position in steps of numBytes, so the
+ * filesystem can allocate large contiguous extents. Pass 0 to disable.
+ * Only has an effect where fallocate() is available (Linux).
+ * Returns 0 or negative error code.
+ */
+long Audio_WAV_SetPreallocation( WAV_Writer *writer, long numBytes );
+
+/*********************************************************************************
+ * Add a Broadcast WAV (EBU Tech 3285) bext chunk to the header, before any samples
+ * are written and before Audio_WAV_SetMemoryMapped(). The strings are cut to the
+ * field sizes of 256, 32, 10 ("yyyy-mm-dd") and 8 ("hh:mm:ss") characters.
+ * timeReference is the position of the first frame on the recorder's timeline, in
+ * frames, which editors use to line up files recorded together.
+ * Returns 0 or negative error code.
+ */
+long Audio_WAV_SetBroadcastInfo( WAV_Writer *writer, const char *description, const char *originator,
+        const char *originationDate, const char *originationTime, unsigned long long timeReference );
+
+/*********************************************************************************
+ * Bring the RIFF and data sizes in the header up to date every numBytes of sample
+ * data, so that a file of a recording that never got closed, for example because of
+ * a crash, still plays up to the last update. Each update is a single positioned
+ * write of the header, which leaves the file position of the writes alone.
+ * Pass 0 to disable. Has no effect on Windows, which has no pwrite().
+ * Returns 0 or negative error code.
+ */
+long Audio_WAV_SetHeaderRefresh( WAV_Writer *writer, long numBytes );
+
+/*********************************************************************************
+ * Switch the writer to memory mapped mode, before any samples are written.
+ * The file then grows in steps of WAV_MAP_WINDOW_SIZE bytes of allocated disk space,
+ * and Audio_WAV_BeginWrite() hands out the mapped file pages to write samples into,
+ * with no copy through the block buffer and no write() call per block.
+ * Only available on Linux, where the space can be allocated before it is mapped, so a
+ * full disk makes a write fail instead of crashing on a page fault. Other systems keep
+ * the buffered writer.
+ * Returns 0, or negative error code if the writer stays buffered.
+ */
+long Audio_WAV_SetMemoryMapped( WAV_Writer *writer );
+
+/*********************************************************************************
+ * Reserve numBytes of the data chunk in a memory mapped writer and return where to
+ * write them, in the file's sample format and little endian byte order. The bytes are
+ * added to the file by Audio_WAV_EndWrite(). numBytes must be a whole number of frames,
+ * and no more than WAV_MAP_WINDOW_SIZE / 2.
+ * Returns NULL if the writer is not memory mapped or the disk space cannot be allocated.
+ */
+unsigned char *Audio_WAV_BeginWrite( WAV_Writer *writer, long numBytes );
+
+/*********************************************************************************
+ * Add the first numBytes reserved by the last Audio_WAV_BeginWrite() to the data chunk.
+ * Returns numBytes or negative error code.
+ */
+long Audio_WAV_EndWrite( WAV_Writer *writer, long numBytes );
+
+/*********************************************************************************
+ * Mark a sample frame of the data chunk with a cue point and a text label, which
+ * most audio editors show as a marker. Only frames below 2^32 can be marked.
+ * Returns 0 or negative error code.
+ */
+long Audio_WAV_AddCue( WAV_Writer *writer, unsigned long long frame, const char *label );
+
+/*********************************************************************************
+ * Repair the header of a WAV file that was not closed, so that its data chunk
+ * covers all whole frames up to the end of the file. This recovers recordings
+ * from a crash, including files of writers without header refresh, whose header
+ * says the file is empty. Trailing frames of silence past the data size in the header
+ * are dropped with the unwritten space that memory mapped writers leave at the end;
+ * the frames the header already covers are always kept. Files too large for a RIFF
+ * header become RF64 files if they have the JUNK chunk reserved for that, and are
+ * cut at 4 GB otherwise. Sets *dataSize to the size of the data chunk if not NULL.
+ * Returns 1 if the header was repaired, 0 if the file was intact, or negative error code.
+ */
+long Audio_WAV_RepairFile( const char *fileName, unsigned long long *dataSize );
+
 /*********************************************************************************
  * Close WAV file.
  * Update chunk sizes so it can be read by audio applications.
+ * Returns 0 or negative error code.
  */
 long Audio_WAV_CloseWriter( WAV_Writer *writer );
 
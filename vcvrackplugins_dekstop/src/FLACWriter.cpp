@@ -0,0 +1,837 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FLACWriter.hpp"
+#include "write_wav.h"
+
+#define FLAC_SUBFRAME_CONSTANT 0
+#define FLAC_SUBFRAME_VERBATIM 1
+#define FLAC_SUBFRAME_FIXED 8
+#define FLAC_SUBFRAME_LPC 32
+
+#define FLAC_STREAMINFO_SIZE 34
+
+
+/* MD5 (RFC 1321) */
+
+static const uint32_t md5K[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+	0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+	0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+	0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+	0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+	0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+	0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+	0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const int md5Shift[16] = {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+
+void FLACMD5::reset() {
+	state[0] = 0x67452301;
+	state[1] = 0xefcdab89;
+	state[2] = 0x98badcfe;
+	state[3] = 0x10325476;
+	numBytes = 0;
+}
+
+void FLACMD5::transform(const unsigned char *data) {
+	uint32_t m[16];
+	for (int i = 0; i < 16; i++)
+		m[i] = data[4*i] | (data[4*i + 1] << 8) | (data[4*i + 2] << 16) | ((uint32_t) data[4*i + 3] << 24);
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	for (int i = 0; i < 64; i++) {
+		uint32_t f;
+		int g;
+		switch (i / 16) {
+			case 0: f = (b & c) | (~b & d); g = i; break;
+			case 1: f = (d & b) | (~d & c); g = (5*i + 1) % 16; break;
+			case 2: f = b ^ c ^ d; g = (3*i + 5) % 16; break;
+			default: f = c ^ (b | ~d); g = (7*i) % 16; break;
+		}
+		f += a + md5K[i] + m[g];
+		int s = md5Shift[(i / 16) * 4 + i % 4];
+		a = d;
+		d = c;
+		c = b;
+		b += (f << s) | (f >> (32 - s));
+	}
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+void FLACMD5::update(const unsigned char *data, size_t size) {
+	size_t used = numBytes % 64;
+	numBytes += size;
+	if (used > 0) {
+		size_t n = 64 - used < size ? 64 - used : size;
+		memcpy(block + used, data, n);
+		data += n;
+		size -= n;
+		if (used + n < 64)
+			return;
+		transform(block);
+	}
+	for (; size >= 64; data += 64, size -= 64)
+		transform(data);
+	memcpy(block, data, size);
+}
+
+void FLACMD5::finish(unsigned char digest[16]) {
+	uint64_t bits = numBytes * 8;
+	unsigned char pad[72] = {0x80};
+	size_t padSize = (numBytes % 64 < 56 ? 56 : 120) - numBytes % 64;
+	for (int i = 0; i < 8; i++)
+		pad[padSize + i] = (unsigned char) (bits >> (8*i));
+	update(pad, padSize + 8);
+	for (int i = 0; i < 16; i++)
+		digest[i] = (unsigned char) (state[i / 4] >> (8 * (i % 4)));
+}
+
+
+/* Bitstream */
+
+struct FLACCRCTables {
+	uint8_t crc8[256];
+	uint16_t crc16[256];
+
+	FLACCRCTables() {
+		for (int i = 0; i < 256; i++) {
+			uint8_t c8 = i;
+			uint16_t c16 = i << 8;
+			for (int b = 0; b < 8; b++) {
+				c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1;
+				c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1;
+			}
+			crc8[i] = c8;
+			crc16[i] = c16;
+		}
+	}
+};
+
+static const FLACCRCTables crcTables;
+
+static uint8_t crc8(const unsigned char *data, size_t size) {
+	uint8_t crc = 0;
+	for (size_t i = 0; i < size; i++)
+		crc = crcTables.crc8[crc ^ data[i]];
+	return crc;
+}
+
+static uint16_t crc16(const unsigned char *data, size_t size) {
+	uint16_t crc = 0;
+	for (size_t i = 0; i < size; i++)
+		crc = (crc << 8) ^ crcTables.crc16[(crc >> 8) ^ data[i]];
+	return crc;
+}
+
+/** Packs values MSB first into a buffer that is large enough for the whole frame. */
+struct FLACBitWriter {
+	unsigned char *data;
+	size_t pos = 0;
+	uint64_t bitBuffer = 0;
+	int numBits = 0;
+
+	FLACBitWriter(unsigned char *data) : data(data) {}
+
+	// Up to 32 bits; values wider than n bits are truncated, so negative numbers need no masking.
+	void write(uint32_t value, int n) {
+		if (n < 32)
+			value &= (1u << n) - 1;
+		bitBuffer = (bitBuffer << n) | value;
+		numBits += n;
+		while (numBits >= 8) {
+			numBits -= 8;
+			data[pos++] = (unsigned char) (bitBuffer >> numBits);
+		}
+	}
+	void writeZeros(uint32_t n) {
+		for (; n > 32; n -= 32)
+			write(0, 32);
+		write(0, n);
+	}
+	// Unary coded quotient and k bit remainder of a folded residual.
+	void writeRice(uint32_t u, int k) {
+		uint32_t q = u >> k;
+		if (q + 1 + k <= 32) {
+			write((1u << k) | (u & ((1u << k) - 1)), q + 1 + k);
+		}
+		else {
+			writeZeros(q);
+			write(1, 1);
+			write(u, k);
+		}
+	}
+	void alignToByte() {
+		if (numBits > 0)
+			write(0, 8 - numBits);
+	}
+};
+
+// Maps residuals to unsigned numbers: 0, -1, 1, -2, 2... become 0, 1, 2, 3, 4...
+static inline uint32_t fold(int32_t r) {
+	return ((uint32_t) r << 1) ^ (uint32_t) (r >> 31);
+}
+
+static int ilog2(uint32_t v) {
+	int l = 0;
+	while (v >>= 1)
+		l++;
+	return l;
+}
+
+
+/* Analysis */
+
+// Best Rice parameter for a partition of n folded residuals that sum to `sum`. Each value costs a
+// stop bit, k remainder bits and its quotient; the quotients add up to about sum >> k.
+static uint64_t riceBits(uint64_t sum, uint32_t n, int *param) {
+	int k = 0;
+	uint64_t bits = n + sum;
+	while (k < 30) {
+		uint64_t next = (uint64_t) n * (k + 2) + (sum >> (k + 1));
+		if (next >= bits)
+			break;
+		bits = next;
+		k++;
+	}
+	*param = k;
+	return bits;
+}
+
+// Chooses the partition order and the Rice parameters for the residual of samples order..n-1,
+// and returns the size of the coded residual in bits.
+static uint64_t chooseRiceParameters(FLACSubframe *subframe, int n) {
+	const int32_t *residual = subframe->residual.data();
+	int order = subframe->order;
+	int maxPartitionOrder = 0;
+	while (maxPartitionOrder < FLAC_MAX_PARTITION_ORDER && (n % (2 << maxPartitionOrder)) == 0 && (n >> (maxPartitionOrder + 1)) > order)
+		maxPartitionOrder++;
+
+	// Sums at the finest partitioning, merged pairwise for every coarser one.
+	uint64_t sums[1 << FLAC_MAX_PARTITION_ORDER];
+	int partitionSize = n >> maxPartitionOrder;
+	for (int p = 0; p < (1 << maxPartitionOrder); p++) {
+		uint64_t sum = 0;
+		for (int i = (p == 0) ? order : p * partitionSize; i < (p + 1) * partitionSize; i++)
+			sum += fold(residual[i]);
+		sums[p] = sum;
+	}
+
+	uint64_t bestBits = UINT64_MAX;
+	for (int po = maxPartitionOrder; po >= 0; po--) {
+		int numPartitions = 1 << po;
+		uint64_t bits = 6;
+		int params[1 << FLAC_MAX_PARTITION_ORDER];
+		int maxParam = 0;
+		for (int p = 0; p < numPartitions; p++) {
+			uint32_t count = (n >> po) - (p == 0 ? order : 0);
+			bits += riceBits(sums[p], count, &params[p]);
+			if (params[p] > maxParam)
+				maxParam = params[p];
+		}
+		int method = (maxParam > 14) ? 1 : 0;
+		bits += numPartitions * (4 + method);
+		if (bits < bestBits) {
+			bestBits = bits;
+			subframe->partitionOrder = po;
+			subframe->riceMethod = method;
+			for (int p = 0; p < numPartitions; p++)
+				subframe->riceParams[p] = params[p];
+		}
+		for (int p = 0; p < numPartitions / 2; p++)
+			sums[p] = sums[2*p] + sums[2*p + 1];
+	}
+	return bestBits;
+}
+
+static void fixedResidual(const int32_t *x, int n, int order, int32_t *r) {
+	for (int i = order; i < n; i++) {
+		switch (order) {
+			case 0: r[i] = x[i]; break;
+			case 1: r[i] = x[i] - x[i-1]; break;
+			case 2: r[i] = x[i] - 2*x[i-1] + x[i-2]; break;
+			case 3: r[i] = x[i] - 3*x[i-1] + 3*x[i-2] - x[i-3]; break;
+			default: r[i] = x[i] - 4*x[i-1] + 6*x[i-2] - 4*x[i-3] + x[i-4]; break;
+		}
+	}
+}
+
+// The fixed predictor with the smallest sum of absolute residuals.
+static int chooseFixedOrder(const int32_t *x, int n) {
+	int maxOrder = n > 4 ? 4 : n - 1;
+	uint64_t sums[5] = {};
+	for (int i = maxOrder; i < n; i++) {
+		int64_t e0 = x[i];
+		int64_t e1 = e0 - x[i-1];
+		int64_t e2 = e1 - (x[i-1] - (int64_t) x[i-2]);
+		int64_t e3 = e2 - (x[i-1] - 2 * (int64_t) x[i-2] + x[i-3]);
+		int64_t e4 = e3 - (x[i-1] - 3 * (int64_t) x[i-2] + 3 * (int64_t) x[i-3] - x[i-4]);
+		sums[0] += llabs(e0);
+		sums[1] += llabs(e1);
+		sums[2] += llabs(e2);
+		sums[3] += llabs(e3);
+		sums[4] += llabs(e4);
+	}
+	int best = 0;
+	for (int order = 1; order <= maxOrder; order++) {
+		if (sums[order] < sums[best])
+			best = order;
+	}
+	return best;
+}
+
+// Levinson-Durbin recursion. Fills coefs[o-1][] with the predictor of order o, for which
+// x[i] is about the sum of coefs[o-1][j] * x[i-1-j], and error[o-1] with its prediction error.
+// Returns the highest order computed, which is lower than maxOrder for perfectly predictable signals.
+static int computeLPC(const double *autoc, int maxOrder, double coefs[][FLAC_MAX_LPC_ORDER], double *error) {
+	double lpc[FLAC_MAX_LPC_ORDER];
+	double err = autoc[0];
+	for (int i = 0; i < maxOrder; i++) {
+		double r = -autoc[i+1];
+		for (int j = 0; j < i; j++)
+			r -= lpc[j] * autoc[i-j];
+		r /= err;
+		lpc[i] = r;
+		int j = 0;
+		for (; j < i / 2; j++) {
+			double tmp = lpc[j];
+			lpc[j] += r * lpc[i-1-j];
+			lpc[i-1-j] += r * tmp;
+		}
+		if (i & 1)
+			lpc[j] += lpc[j] * r;
+		err *= 1.0 - r * r;
+		for (j = 0; j <= i; j++)
+			coefs[i][j] = -lpc[j];
+		error[i] = err;
+		if (err <= 0.0)
+			return i + 1;
+	}
+	return maxOrder;
+}
+
+// Quantizes the coefficients to `precision` bits with error feedback. Returns false if they
+// cannot be represented with a shift FLAC allows.
+static bool quantizeLPC(const double *coefs, int order, int precision, int32_t *qcoefs, int *shift) {
+	double cmax = 0.0;
+	for (int i = 0; i < order; i++)
+		cmax = fmax(cmax, fabs(coefs[i]));
+	if (cmax <= 0.0)
+		return false;
+	int log2cmax;
+	frexp(cmax, &log2cmax);
+	log2cmax--;
+	int s = precision - 2 - log2cmax;
+	if (s > 15)
+		s = 15;
+	if (s < 0)
+		return false;
+
+	int32_t qmax = (1 << (precision - 1)) - 1;
+	int32_t qmin = -(1 << (precision - 1));
+	double error = 0.0;
+	for (int i = 0; i < order; i++) {
+		error += coefs[i] * (1 << s);
+		long q = lround(error);
+		q = q > qmax ? qmax : q < qmin ? qmin : q;
+		error -= q;
+		qcoefs[i] = q;
+	}
+	*shift = s;
+	return true;
+}
+
+// Returns false if a residual is too large to code, which only happens with unstable predictors.
+static bool lpcResidual(const int32_t *x, int n, const int32_t *qcoefs, int order, int shift, int32_t *r) {
+	for (int i = order; i < n; i++) {
+		int64_t sum = 0;
+		for (int j = 0; j < order; j++)
+			sum += (int64_t) qcoefs[j] * x[i-1-j];
+		int64_t e = x[i] - (sum >> shift);
+		if (e >= (1 << 30) || e < -(1 << 30))
+			return false;
+		r[i] = (int32_t) e;
+	}
+	return true;
+}
+
+// Finds the smallest coding of n samples: constant, fixed predictor, LPC, or verbatim.
+// Tukey window with a taper of a quarter block on each side
+static void tukeyWindow(float *w, int n) {
+	int taper = n / 4;
+	for (int i = 0; i < n; i++) {
+		int d = i < n - 1 - i ? i : n - 1 - i;
+		w[i] = d >= taper ? 1.f : 0.5f * (1.f - cosf(M_PI * d / taper));
+	}
+}
+
+void FLACWriter::analyzeSubframe(FLACSubframe *subframe, const int32_t *x, int bps, int n) {
+	subframe->signal = x;
+	subframe->bitsPerSample = bps;
+
+	bool constant = true;
+	for (int i = 1; i < n && constant; i++)
+		constant = (x[i] == x[0]);
+	if (constant) {
+		subframe->type = FLAC_SUBFRAME_CONSTANT;
+		subframe->bits = 8 + bps;
+		return;
+	}
+	subframe->type = FLAC_SUBFRAME_VERBATIM;
+	subframe->bits = 8 + (uint64_t) n * bps;
+
+	int fixedOrder = chooseFixedOrder(x, n);
+	subframe->order = fixedOrder;
+	fixedResidual(x, n, fixedOrder, subframe->residual.data());
+	uint64_t bits = 8 + fixedOrder * bps + chooseRiceParameters(subframe, n);
+	if (bits < subframe->bits) {
+		subframe->type = FLAC_SUBFRAME_FIXED;
+		subframe->bits = bits;
+	}
+
+	int maxOrder = n > 2 * FLAC_MAX_LPC_ORDER ? FLAC_MAX_LPC_ORDER : 0;
+	if (maxOrder == 0)
+		return;
+
+	// Autocorrelation of the windowed block
+	if (windowLength != n) {
+		// Only the last, partial block of a file gets here; open() made the full one
+		tukeyWindow(window.data(), n);
+		windowLength = n;
+	}
+	double autoc[FLAC_MAX_LPC_ORDER + 1] = {};
+	float *w = windowed.data();
+	for (int i = 0; i < n; i++)
+		w[i] = x[i] * window[i];
+	for (int lag = 0; lag <= maxOrder; lag++) {
+		double sum = 0.0;
+		for (int i = lag; i < n; i++)
+			sum += (double) w[i] * w[i - lag];
+		autoc[lag] = sum;
+	}
+	if (autoc[0] <= 0.0)
+		return;
+
+	double coefs[FLAC_MAX_LPC_ORDER][FLAC_MAX_LPC_ORDER];
+	double error[FLAC_MAX_LPC_ORDER];
+	maxOrder = computeLPC(autoc, maxOrder, coefs, error);
+
+	// Pick the order from the expected residual size: about half of log2 of the error
+	// variance per sample, plus the warm-up samples and coefficients in the header.
+	int order = 1;
+	double bestEstimate = HUGE_VAL;
+	for (int o = 1; o <= maxOrder; o++) {
+		double variance = error[o-1] * 0.5 / n;
+		double bitsPerResidual = variance > 1.0 ? 0.5 * log2(variance) : 0.0;
+		double estimate = bitsPerResidual * (n - o) + o * (bps + 15);
+		if (estimate < bestEstimate) {
+			bestEstimate = estimate;
+			order = o;
+		}
+	}
+
+	// Keep the prediction of 16 bit audio within 32 bits, as simple decoders expect.
+	int precision = 15;
+	if (bps <= 17) {
+		int maxPrecision = 32 - bps - ilog2(order);
+		precision = maxPrecision < 5 ? 5 : maxPrecision < 15 ? maxPrecision : 15;
+	}
+	int32_t qcoefs[FLAC_MAX_LPC_ORDER];
+	int shift;
+	if (!quantizeLPC(coefs[order-1], order, precision, qcoefs, &shift))
+		return;
+	if (!lpcResidual(x, n, qcoefs, order, shift, trialResidual.data()))
+		return;
+
+	// Try the LPC residual in place of the fixed one, and swap it back if it turns out larger.
+	subframe->residual.swap(trialResidual);
+	int fixedPartitionOrder = subframe->partitionOrder;
+	int fixedRiceMethod = subframe->riceMethod;
+	uint8_t fixedParams[1 << FLAC_MAX_PARTITION_ORDER];
+	memcpy(fixedParams, subframe->riceParams, sizeof(fixedParams));
+	subframe->order = order;
+	bits = 8 + order * bps + 4 + 5 + order * precision + chooseRiceParameters(subframe, n);
+	if (bits < subframe->bits) {
+		subframe->type = FLAC_SUBFRAME_LPC;
+		subframe->bits = bits;
+		subframe->precision = precision;
+		subframe->shift = shift;
+		memcpy(subframe->coefs, qcoefs, order * sizeof(int32_t));
+	}
+	else {
+		subframe->residual.swap(trialResidual);
+		subframe->order = fixedOrder;
+		subframe->partitionOrder = fixedPartitionOrder;
+		subframe->riceMethod = fixedRiceMethod;
+		memcpy(subframe->riceParams, fixedParams, sizeof(fixedParams));
+	}
+}
+
+
+/* Frames */
+
+static void writeSubframe(FLACBitWriter &bw, const FLACSubframe *subframe, int n) {
+	const int32_t *x = subframe->signal;
+	int bps = subframe->bitsPerSample;
+	int type = subframe->type;
+	if (type == FLAC_SUBFRAME_FIXED)
+		type |= subframe->order;
+	else if (type == FLAC_SUBFRAME_LPC)
+		type |= subframe->order - 1;
+	bw.write(type << 1, 8);
+
+	if (subframe->type == FLAC_SUBFRAME_CONSTANT) {
+		bw.write(x[0], bps);
+		return;
+	}
+	if (subframe->type == FLAC_SUBFRAME_VERBATIM) {
+		for (int i = 0; i < n; i++)
+			bw.write(x[i], bps);
+		return;
+	}
+
+	int order = subframe->order;
+	for (int i = 0; i < order; i++)
+		bw.write(x[i], bps);
+	if (subframe->type == FLAC_SUBFRAME_LPC) {
+		bw.write(subframe->precision - 1, 4);
+		bw.write(subframe->shift, 5);
+		for (int i = 0; i < order; i++)
+			bw.write(subframe->coefs[i], subframe->precision);
+	}
+
+	bw.write(subframe->riceMethod, 2);
+	bw.write(subframe->partitionOrder, 4);
+	int partitionSize = n >> subframe->partitionOrder;
+	const int32_t *residual = subframe->residual.data();
+	for (int p = 0; p < (1 << subframe->partitionOrder); p++) {
+		int k = subframe->riceParams[p];
+		bw.write(k, 4 + subframe->riceMethod);
+		for (int i = (p == 0) ? order : p * partitionSize; i < (p + 1) * partitionSize; i++)
+			bw.writeRice(fold(residual[i]), k);
+	}
+}
+
+// Sample rate code of the frame header, with the rate itself at the end of the header for the uncommon ones.
+static int sampleRateCode(int rate, uint32_t *extra, int *extraBits) {
+	const int rates[] = {0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000};
+	for (int code = 1; code < 12; code++) {
+		if (rates[code] == rate)
+			return code;
+	}
+	if (rate % 1000 == 0 && rate / 1000 < 256) {
+		*extra = rate / 1000;
+		*extraBits = 8;
+		return 12;
+	}
+	if (rate < 65536) {
+		*extra = rate;
+		*extraBits = 16;
+		return 13;
+	}
+	if (rate % 10 == 0 && rate / 10 < 65536) {
+		*extra = rate / 10;
+		*extraBits = 16;
+		return 14;
+	}
+	return 0;
+}
+
+long FLACWriter::encodeFrame() {
+	int n = blockFill;
+	int bps = bitsPerSample;
+
+	// Stereo files try left/right, left/side, side/right and mid/side, and keep the smallest.
+	const FLACSubframe *coded[FLAC_MAX_CHANNELS];
+	int channelAssignment = numChannels - 1;
+	for (int c = 0; c < numChannels; c++) {
+		analyzeSubframe(&subframes[c], channels[c].data(), bps, n);
+		coded[c] = &subframes[c];
+	}
+	if (numChannels == 2) {
+		const int32_t *left = channels[0].data();
+		const int32_t *right = channels[1].data();
+		for (int i = 0; i < n; i++) {
+			side[i] = left[i] - right[i];
+			mid[i] = (left[i] + right[i]) >> 1;
+		}
+		analyzeSubframe(&subframes[2], side.data(), bps + 1, n);
+		analyzeSubframe(&subframes[3], mid.data(), bps, n);
+		uint64_t l = subframes[0].bits, r = subframes[1].bits, s = subframes[2].bits, m = subframes[3].bits;
+		uint64_t best = l + r;
+		if (l + s < best) {
+			best = l + s;
+			channelAssignment = 8;
+			coded[1] = &subframes[2];
+		}
+		if (s + r < best) {
+			best = s + r;
+			channelAssignment = 9;
+			coded[0] = &subframes[2];
+			coded[1] = &subframes[1];
+		}
+		if (m + s < best) {
+			channelAssignment = 10;
+			coded[0] = &subframes[3];
+			coded[1] = &subframes[2];
+		}
+	}
+
+	FLACBitWriter bw(frameBuffer.data());
+	// Frame header, with fixed block size numbering
+	bw.write(0x3ffe, 14);
+	bw.write(0, 2);
+	int blockSizeCode = (n == FLAC_BLOCKSIZE) ? 12 : (n <= 256) ? 6 : 7;
+	uint32_t rateExtra = 0;
+	int rateExtraBits = 0;
+	bw.write(blockSizeCode, 4);
+	bw.write(sampleRateCode(sampleRate, &rateExtra, &rateExtraBits), 4);
+	bw.write(channelAssignment, 4);
+	bw.write(bps == 24 ? 6 : 4, 3);
+	bw.write(0, 1);
+	// Frame number in the UTF-8 like variable length code
+	if (frameNumber < 0x80) {
+		bw.write(frameNumber, 8);
+	}
+	else {
+		int numBytes = 2;
+		while (numBytes < 6 && frameNumber >= (1u << (5 * numBytes + 1)))
+			numBytes++;
+		bw.write((0xff00 >> numBytes) | (frameNumber >> (6 * (numBytes - 1))), 8);
+		for (int i = numBytes - 2; i >= 0; i--)
+			bw.write(0x80 | ((frameNumber >> (6 * i)) & 0x3f), 8);
+	}
+	if (blockSizeCode != 12)
+		bw.write(n - 1, blockSizeCode == 6 ? 8 : 16);
+	if (rateExtraBits > 0)
+		bw.write(rateExtra, rateExtraBits);
+	bw.write(crc8(bw.data, bw.pos), 8);
+
+	for (int c = 0; c < numChannels; c++)
+		writeSubframe(bw, coded[c], n);
+	bw.alignToByte();
+	bw.write(crc16(bw.data, bw.pos), 16);
+
+	if (fwrite(bw.data, 1, bw.pos, file) != bw.pos)
+		return -1;
+	if (frameNumber == 0 || bw.pos < minFrameSize)
+		minFrameSize = bw.pos;
+	if (bw.pos > maxFrameSize)
+		maxFrameSize = bw.pos;
+	frameNumber++;
+	totalFrames += n;
+	blockFill = 0;
+	return 0;
+}
+
+
+/* Files */
+
+void FLACWriter::writeStreamInfo(unsigned char *p) {
+	FLACBitWriter bw(p);
+	bw.write(FLAC_BLOCKSIZE, 16);
+	bw.write(FLAC_BLOCKSIZE, 16);
+	bw.write(minFrameSize, 24);
+	bw.write(maxFrameSize, 24);
+	bw.write(sampleRate, 20);
+	bw.write(numChannels - 1, 3);
+	bw.write(bitsPerSample - 1, 5);
+	bw.write((uint32_t) (totalFrames >> 32), 4);
+	bw.write((uint32_t) totalFrames, 32);
+	FLACMD5 digest = md5;
+	digest.finish(p + bw.pos);
+}
+
+long FLACWriter::open(const char *fileName, int frameRate, int samplesPerFrame, int sampleFormat, long long timeReference) {
+	if (samplesPerFrame < 1 || samplesPerFrame > FLAC_MAX_CHANNELS || frameRate < 1 || frameRate >= (1 << 20))
+		return WAV_ERR_ILLEGAL_VALUE;
+	if (sampleFormat != WAV_SAMPLE_INT16 && sampleFormat != WAV_SAMPLE_INT24)
+		return WAV_ERR_FORMAT_TYPE;
+
+	sampleRate = frameRate;
+	numChannels = samplesPerFrame;
+	bitsPerSample = (sampleFormat == WAV_SAMPLE_INT24) ? 24 : 16;
+	totalFrames = 0;
+	frameNumber = 0;
+	minFrameSize = 0;
+	maxFrameSize = 0;
+	blockFill = 0;
+	md5.reset();
+
+	for (int c = 0; c < numChannels; c++)
+		channels[c].resize(FLAC_BLOCKSIZE);
+	mid.resize(FLAC_BLOCKSIZE);
+	side.resize(FLAC_BLOCKSIZE);
+	for (int i = 0; i < numChannels + 2; i++)
+		subframes[i].residual.resize(FLAC_BLOCKSIZE);
+	trialResidual.resize(FLAC_BLOCKSIZE);
+	windowed.resize(FLAC_BLOCKSIZE);
+	window.resize(FLAC_BLOCKSIZE);
+	tukeyWindow(window.data(), FLAC_BLOCKSIZE);
+	windowLength = FLAC_BLOCKSIZE;
+	// A verbatim frame with its headers is the largest a frame can get.
+	frameBuffer.resize(numChannels * (FLAC_BLOCKSIZE * (bitsPerSample + 1) / 8 + 2) + 32);
+
+	file = fopen(fileName, "wb");
+	if (file == NULL)
+		return -1;
+	// Marker and STREAMINFO, which close() completes with the sizes and the MD5
+	unsigned char header[8 + FLAC_STREAMINFO_SIZE + 128] = {'f', 'L', 'a', 'C', 0x80, 0, 0, FLAC_STREAMINFO_SIZE};
+	writeStreamInfo(header + 8);
+	size_t headerSize = 8 + FLAC_STREAMINFO_SIZE;
+	if (timeReference >= 0) {
+		// Last metadata block: VORBIS_COMMENT with a vendor string and one comment, little endian lengths
+		const char vendor[] = "dekstop Recorder";
+		char comment[64];
+		int commentSize = snprintf(comment, sizeof(comment), "TIME_REFERENCE=%lld", timeReference);
+		uint32_t blockSize = 4 + (sizeof(vendor) - 1) + 4 + 4 + commentSize;
+		header[4] = 0;
+		unsigned char *p = header + headerSize;
+		*p++ = 0x80 | 4;
+		for (int shift = 16; shift >= 0; shift -= 8)
+			*p++ = (unsigned char) (blockSize >> shift);
+		const uint32_t fields[] = {(uint32_t) (sizeof(vendor) - 1), 1, (uint32_t) commentSize};
+		for (int i = 0; i < 3; i++) {
+			for (int shift = 0; shift < 32; shift += 8)
+				*p++ = (unsigned char) (fields[i] >> shift);
+			if (i == 0) {
+				memcpy(p, vendor, sizeof(vendor) - 1);
+				p += sizeof(vendor) - 1;
+			}
+		}
+		memcpy(p, comment, commentSize);
+		p += commentSize;
+		headerSize = p - header;
+	}
+	if (fwrite(header, 1, headerSize, file) != headerSize) {
+		fclose(file);
+		file = NULL;
+		return -1;
+	}
+	return headerSize;
+}
+
+long FLACWriter::writeBytes(const void *data, long numBytes) {
+	int bytesPerSample = bitsPerSample / 8;
+	long bytesPerFrame = bytesPerSample * numChannels;
+	if (file == NULL || numBytes % bytesPerFrame != 0)
+		return WAV_ERR_ILLEGAL_VALUE;
+	const unsigned char *p = (const unsigned char*) data;
+	md5.update(p, numBytes);
+
+	for (long numFrames = numBytes / bytesPerFrame; numFrames > 0;) {
+		int n = FLAC_BLOCKSIZE - blockFill < numFrames ? FLAC_BLOCKSIZE - blockFill : numFrames;
+		for (int c = 0; c < numChannels; c++) {
+			int32_t *dest = channels[c].data() + blockFill;
+			const unsigned char *src = p + c * bytesPerSample;
+			if (bytesPerSample == 2) {
+				for (int i = 0; i < n; i++, src += bytesPerFrame)
+					dest[i] = (int16_t) (src[0] | (src[1] << 8));
+			}
+			else {
+				for (int i = 0; i < n; i++, src += bytesPerFrame)
+					dest[i] = (int32_t) ((uint32_t) src[0] << 8 | (uint32_t) src[1] << 16 | (uint32_t) src[2] << 24) >> 8;
+			}
+		}
+		p += n * bytesPerFrame;
+		numFrames -= n;
+		blockFill += n;
+		if (blockFill == FLAC_BLOCKSIZE && encodeFrame() < 0)
+			return -1;
+	}
+	return numBytes;
+}
+
+long FLACWriter::close() {
+	if (file == NULL)
+		return 0;
+	long result = 0;
+	if (blockFill > 0)
+		result = encodeFrame();
+	unsigned char streamInfo[FLAC_STREAMINFO_SIZE];
+	writeStreamInfo(streamInfo);
+	if (result == 0 && (fseek(file, 8, SEEK_SET) != 0 || fwrite(streamInfo, 1, sizeof(streamInfo), file) != sizeof(streamInfo)))
+		result = -1;
+	if (fclose(file) != 0)
+		result = -1;
+	file = NULL;
+	return result;
+}
+
+
+/*********************************************************************************
+ * Benchmark: 8 channels of 24 bit audio at 96 kHz, written raw with Audio_WAV_WriteBytes()
+ * and encoded with FLACWriter. Reports the file sizes and the CPU time per second of audio.
+ * The test signal is a few sines per channel plus noise at -100 dB, a little kinder to the
+ * encoder than music.
+ */
+#if 0
+#include <time.h>
+#include <stdlib.h>
+#include "PCMConvert.hpp"
+
+int main() {
+	const int numChannels = 8, sampleRate = 96000, seconds = 60, sampleFormat = WAV_SAMPLE_INT24;
+	const int blockFrames = 4096;
+	static float samples[blockFrames * numChannels];
+	static unsigned char bytes[4 * blockFrames * numChannels];
+	double phase[numChannels] = {};
+
+	WAV_Writer wav;
+	FLACWriter flac;
+	if (Audio_WAV_OpenWriterFormat(&wav, "bench.wav", sampleRate, numChannels, sampleFormat) < 0) return 1;
+	if (flac.open("bench.flac", sampleRate, numChannels, sampleFormat) < 0) return 1;
+
+	clock_t wavTime = 0, flacTime = 0;
+	for (int block = 0; block < seconds * sampleRate / blockFrames; block++) {
+		for (int i = 0; i < blockFrames; i++) {
+			for (int c = 0; c < numChannels; c++) {
+				phase[c] += 2 * M_PI * 110 * (c + 1) / sampleRate;
+				samples[i*numChannels + c] = 0.3 * sin(phase[c]) + 0.1 * sin(3.01 * phase[c]) + 1e-5 * (rand() / (double) RAND_MAX - 0.5);
+			}
+		}
+		size_t numBytes = pcmConvert(sampleFormat, samples, bytes, blockFrames, numChannels, NULL);
+		clock_t start = clock();
+		if (Audio_WAV_WriteBytes(&wav, bytes, numBytes) < 0) return 1;
+		wavTime += clock() - start;
+		start = clock();
+		if (flac.writeBytes(bytes, numBytes) < 0) return 1;
+		flacTime += clock() - start;
+	}
+	clock_t start = clock();
+	if (Audio_WAV_CloseWriter(&wav) < 0) return 1;
+	wavTime += clock() - start;
+	start = clock();
+	if (flac.close() < 0) return 1;
+	flacTime += clock() - start;
+
+	FILE *f = fopen("bench.wav", "rb");
+	fseek(f, 0, SEEK_END);
+	long wavSize = ftell(f);
+	fclose(f);
+	f = fopen("bench.flac", "rb");
+	fseek(f, 0, SEEK_END);
+	long flacSize = ftell(f);
+	fclose(f);
+
+	printf("WAV:  %8.1f MB, CPU %6.2f ms per second of audio\n", wavSize / 1048576.0, 1000.0 * wavTime / CLOCKS_PER_SEC / seconds);
+	printf("FLAC: %8.1f MB, CPU %6.2f ms per second of audio, %.1f%% of the WAV size\n", flacSize / 1048576.0,
+		1000.0 * flacTime / CLOCKS_PER_SEC / seconds, 100.0 * flacSize / wavSize);
+	remove("bench.wav");
+	remove("bench.flac");
+	return 0;
+}
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// Lossless FLAC encoder for the recorder writer threads, without external libraries.
+// It writes subset streams that any FLAC decoder can play: 4096 frame blocks, fixed and LPC
+// predictors up to order 12, Rice coded residuals and mid/side coding of stereo files.
+
+#define FLAC_BLOCKSIZE 4096
+#define FLAC_MAX_CHANNELS 8
+#define FLAC_MAX_LPC_ORDER 12
+#define FLAC_MAX_PARTITION_ORDER 8
+
+/** Running MD5 of the input samples, stored in the stream so decoders can verify the file. */
+struct FLACMD5 {
+	uint32_t state[4];
+	uint64_t numBytes;
+	unsigned char block[64];
+
+	void reset();
+	void update(const unsigned char *data, size_t size);
+	void finish(unsigned char digest[16]);
+	void transform(const unsigned char *data);
+};
+
+/** How one channel of a block is coded, chosen by FLACWriter::analyzeSubframe(). */
+struct FLACSubframe {
+	const int32_t *signal;
+	int bitsPerSample;
+	int type;
+	int order;
+	int precision; // of the quantized LPC coefficients, in bits
+	int shift; // of the LPC prediction
+	int32_t coefs[FLAC_MAX_LPC_ORDER];
+	int partitionOrder;
+	int riceMethod; // 0 for 4 bit Rice parameters, 1 for 5 bit ones
+	uint8_t riceParams[1 << FLAC_MAX_PARTITION_ORDER];
+	std::vector<int32_t> residual;
+	uint64_t bits; // coded size
+};
+
+/** Writes a FLAC file from the interleaved little endian samples that would go into a WAV file.
+The calls mirror Audio_WAV_OpenWriterFormat(), Audio_WAV_WriteBytes() and Audio_WAV_CloseWriter():
+they return negative error codes, and the open call is the only one that allocates.
+*/
+struct FLACWriter {
+	FILE *file = NULL;
+	int sampleRate = 0;
+	int numChannels = 0;
+	int bitsPerSample = 0;
+	uint64_t totalFrames = 0;
+	uint32_t frameNumber = 0;
+	uint32_t minFrameSize = 0;
+	uint32_t maxFrameSize = 0;
+	FLACMD5 md5;
+
+	// Samples of the block being filled, one array per channel
+	std::vector<int32_t> channels[FLAC_MAX_CHANNELS];
+	int blockFill = 0;
+	// Encoder scratch space: mid and side signals of stereo files, one subframe per candidate signal
+	std::vector<int32_t> mid, side;
+	FLACSubframe subframes[FLAC_MAX_CHANNELS + 2];
+	std::vector<int32_t> trialResidual;
+	std::vector<float> window, windowed;
+	int windowLength = 0; // block length the window was computed for
+	std::vector<unsigned char> frameBuffer;
+
+	/** Opens a file for WAV_SAMPLE_INT16 or WAV_SAMPLE_INT24 samples and up to FLAC_MAX_CHANNELS channels.
+	A timeReference of 0 or more is stored as a TIME_REFERENCE comment, the FLAC counterpart of the
+	Broadcast WAV field of Audio_WAV_SetBroadcastInfo().
+	*/
+	long open(const char *fileName, int frameRate, int samplesPerFrame, int sampleFormat, long long timeReference = -1);
+	/** Encodes whole frames of samples in the sample format of the file. Returns numBytes or a negative error code. */
+	long writeBytes(const void *data, long numBytes);
+	/** Encodes the last partial block and completes the STREAMINFO header. */
+	long close();
+
+	long encodeFrame();
+	void analyzeSubframe(FLACSubframe *subframe, const int32_t *signal, int bitsPerSample, int n);
+	void writeStreamInfo(unsigned char *p);
+};
@@ -0,0 +1,172 @@
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+#include "OverviewWriter.hpp"
+#include "write_wav.h"
+
+#define OVERVIEW_FIRST_LEVEL_FRAMES 256
+#define OVERVIEW_DECIMATION 16 // entries of a level per entry of the next one
+
+
+static void putLE(unsigned char *&p, uint64_t value, int numBytes) {
+	for (int i = 0; i < numBytes; i++) {
+		*p++ = (unsigned char) (value >> (8 * i));
+	}
+}
+
+static int16_t quantize(float x) {
+	return (int16_t) lrintf(std::min(std::max(x, -1.f), 1.f) * 32767.f);
+}
+
+long OverviewWriter::open(const char *fileName, int frameRate, int samplesPerFrame) {
+	if (samplesPerFrame < 1 || samplesPerFrame > OVERVIEW_MAX_CHANNELS || frameRate < 1)
+		return WAV_ERR_ILLEGAL_VALUE;
+
+	sampleRate = frameRate;
+	numChannels = samplesPerFrame;
+	totalFrames = 0;
+	uint32_t framesPerEntry = OVERVIEW_FIRST_LEVEL_FRAMES;
+	for (OverviewLevel &level : levels) {
+		level.framesPerEntry = framesPerEntry;
+		level.numEntries = 0;
+		level.entries.clear();
+		resetEntry(level);
+		framesPerEntry *= OVERVIEW_DECIMATION;
+	}
+	for (int c = 0; c < OVERVIEW_MAX_CHANNELS; c++)
+		peaks[c] = 0.f;
+
+	file = fopen(fileName, "wb");
+	if (file == NULL)
+		return -1;
+	// Placeholder, close() writes the counts and offsets.
+	unsigned char header[OVERVIEW_HEADER_SIZE];
+	writeHeader(header);
+	if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+		fclose(file);
+		file = NULL;
+		return -1;
+	}
+	return sizeof(header);
+}
+
+void OverviewWriter::resetEntry(OverviewLevel &level) {
+	level.fill = 0;
+	for (int c = 0; c < numChannels; c++) {
+		level.min[c] = FLT_MAX;
+		level.max[c] = -FLT_MAX;
+		level.sumSquares[c] = 0.0;
+	}
+}
+
+long OverviewWriter::write(const float *samples, size_t numFrames) {
+	if (file == NULL)
+		return WAV_ERR_ILLEGAL_VALUE;
+	OverviewLevel &level = levels[0];
+	while (numFrames > 0) {
+		size_t n = std::min(numFrames, (size_t) (level.framesPerEntry - level.fill));
+		for (int c = 0; c < numChannels; c++) {
+			const float *s = samples + c;
+			float lo = level.min[c], hi = level.max[c], sum = 0.f;
+			for (size_t f = 0; f < n; f++, s += numChannels) {
+				lo = std::min(lo, *s);
+				hi = std::max(hi, *s);
+				sum += *s * *s;
+			}
+			level.min[c] = lo;
+			level.max[c] = hi;
+			level.sumSquares[c] += sum;
+		}
+		samples += n * numChannels;
+		numFrames -= n;
+		level.fill += n;
+		totalFrames += n;
+		if (level.fill == level.framesPerEntry && finishEntry(0) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+// Encodes the entry, adds it to the next level and starts a new one. Finishes the entry of the
+// next level as well when it is full.
+long OverviewWriter::finishEntry(int l) {
+	OverviewLevel &level = levels[l];
+	unsigned char *p = entry;
+	for (int c = 0; c < numChannels; c++) {
+		putLE(p, (uint16_t) quantize(level.min[c]), 2);
+		putLE(p, (uint16_t) quantize(level.max[c]), 2);
+		putLE(p, (uint16_t) quantize((float) sqrt(level.sumSquares[c] / level.fill)), 2);
+	}
+	size_t entrySize = p - entry;
+	if (l == 0) {
+		if (fwrite(entry, 1, entrySize, file) != entrySize)
+			return -1;
+	}
+	else {
+		level.entries.insert(level.entries.end(), entry, entry + entrySize);
+	}
+	level.numEntries++;
+
+	if (l == OVERVIEW_METER_LEVEL) {
+		for (int c = 0; c < numChannels; c++)
+			peaks[c] = std::max(-level.min[c], level.max[c]);
+	}
+	if (l + 1 < OVERVIEW_NUM_LEVELS) {
+		OverviewLevel &next = levels[l + 1];
+		for (int c = 0; c < numChannels; c++) {
+			next.min[c] = std::min(next.min[c], level.min[c]);
+			next.max[c] = std::max(next.max[c], level.max[c]);
+			next.sumSquares[c] += level.sumSquares[c];
+		}
+		next.fill += level.fill;
+	}
+	resetEntry(level);
+	if (l + 1 < OVERVIEW_NUM_LEVELS && levels[l + 1].fill == levels[l + 1].framesPerEntry)
+		return finishEntry(l + 1);
+	return 0;
+}
+
+void OverviewWriter::writeHeader(unsigned char *p) {
+	const unsigned char magic[4] = {'R', 'P', 'K', 'S'};
+	for (unsigned char byte : magic)
+		*p++ = byte;
+	putLE(p, 1, 4);
+	putLE(p, sampleRate, 4);
+	putLE(p, numChannels, 2);
+	putLE(p, OVERVIEW_NUM_LEVELS, 2);
+	putLE(p, totalFrames, 8);
+	// The levels follow each other, starting after the header.
+	uint64_t offset = OVERVIEW_HEADER_SIZE;
+	for (const OverviewLevel &level : levels) {
+		putLE(p, level.framesPerEntry, 4);
+		putLE(p, 0, 4);
+		putLE(p, level.numEntries, 8);
+		putLE(p, offset, 8);
+		offset += level.numEntries * 6 * numChannels;
+	}
+}
+
+long OverviewWriter::close() {
+	if (file == NULL)
+		return 0;
+	long result = 0;
+	// A partial entry of one level goes into the partial entry of the next.
+	for (int l = 0; l < OVERVIEW_NUM_LEVELS && result == 0; l++) {
+		if (levels[l].fill > 0)
+			result = finishEntry(l);
+	}
+	for (int l = 1; l < OVERVIEW_NUM_LEVELS && result == 0; l++) {
+		std::vector<unsigned char> &entries = levels[l].entries;
+		if (fwrite(entries.data(), 1, entries.size(), file) != entries.size())
+			result = -1;
+	}
+	unsigned char header[OVERVIEW_HEADER_SIZE];
+	writeHeader(header);
+	if (result == 0 && (fseek(file, 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), file) != sizeof(header)))
+		result = -1;
+	if (fclose(file) != 0)
+		result = -1;
+	file = NULL;
+	return result;
+}
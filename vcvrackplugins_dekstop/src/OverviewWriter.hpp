@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// Peak and RMS overview of a recording, written next to it while it records, so that editors and
+// scripts can draw the waveform of a take of several hours without reading the audio.
+//
+// File layout, all values little endian:
+//   0  "RPKS", uint32 version (1), uint32 sample rate, uint16 channels, uint16 levels (3),
+//      uint64 frames
+//  24  per level: uint32 frames per entry (256, 4096, 65536), uint32 0, uint64 entries,
+//      uint64 file offset of the entries
+//  96  entries of the 256 frame level, then those of the 4096 and 65536 frame levels
+// An entry is the minimum, maximum and RMS of each channel in turn, as int16 where full scale
+// (+-5 V) is 32767. The last entry of a level may cover fewer frames. The entries of the first
+// level are written as the take records; the others, and the counts, when it is closed.
+
+#define OVERVIEW_NUM_LEVELS 3
+#define OVERVIEW_MAX_CHANNELS 32
+#define OVERVIEW_HEADER_SIZE (24 + 24 * OVERVIEW_NUM_LEVELS)
+#define OVERVIEW_METER_LEVEL 1 // whose entries set the meter peaks, about 10 per second
+
+/** One decimation level: the entry being filled, and the finished entries of the coarser levels. */
+struct OverviewLevel {
+	uint32_t framesPerEntry = 0;
+	uint32_t fill = 0; // frames in the entry being filled
+	uint64_t numEntries = 0;
+	float min[OVERVIEW_MAX_CHANNELS];
+	float max[OVERVIEW_MAX_CHANNELS];
+	double sumSquares[OVERVIEW_MAX_CHANNELS];
+	std::vector<unsigned char> entries; // kept until close(), except for the first level
+};
+
+/** Writes the overview of the float samples of one recording file.
+Like FLACWriter, the calls return negative error codes of write_wav.h.
+*/
+struct OverviewWriter {
+	FILE *file = NULL;
+	int sampleRate = 0;
+	int numChannels = 0;
+	uint64_t totalFrames = 0;
+	OverviewLevel levels[OVERVIEW_NUM_LEVELS];
+	unsigned char entry[6 * OVERVIEW_MAX_CHANNELS];
+	/** Peak of each channel over the last finished entry of OVERVIEW_METER_LEVEL, for level meters. */
+	float peaks[OVERVIEW_MAX_CHANNELS];
+
+	/** Creates the file for up to OVERVIEW_MAX_CHANNELS channels. */
+	long open(const char *fileName, int frameRate, int samplesPerFrame);
+	/** Adds interleaved frames of numChannels samples, where +-1 is full scale. */
+	long write(const float *samples, size_t numFrames);
+	/** Writes the last partial entries, the coarser levels and the header. */
+	long close();
+
+	long finishEntry(int level);
+	void resetEntry(OverviewLevel &level);
+	void writeHeader(unsigned char *p);
+};
@@ -0,0 +1,327 @@
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// AVX2 code is compiled per function and only called after a CPU check,
+// so the plugin still runs on the SSE2 baseline Rack is built for.
+#include <immintrin.h>
+#define PCM_AVX2_DISPATCH
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define PCM_NEON
+#endif
+
+#include "PCMConvert.hpp"
+#include "write_wav.h"
+
+
+int pcmBytesPerSample(int sampleFormat) {
+	switch (sampleFormat) {
+		case WAV_SAMPLE_INT24: return 3;
+		case WAV_SAMPLE_FLOAT32: return 4;
+		default: return 2;
+	}
+}
+
+// Round a sample already scaled by N = 2^(bits-1) to nearest and saturate to [-N, N-1].
+// The comparisons are ordered so that NaN saturates low, like the x87 fistp the SIMD paths replaced.
+static inline int32_t quantize(float d, float N) {
+	d = d > -N ? d : -N;
+	d = d < N - 1 ? d : N - 1;
+	return (int32_t) lrintf(d);
+}
+
+#ifdef PCM_AVX2_DISPATCH
+static bool haveAVX2() {
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+
+__attribute__((target("avx2")))
+static int float_to_short_avx2(float const *src, short *dest, int len) {
+	const __m256 scale = _mm256_set1_ps(32768.f);
+	const __m256 lo = _mm256_set1_ps(-32768.f);
+	const __m256 hi = _mm256_set1_ps(32767.f);
+	int i = 0;
+	for (; i + 16 <= len; i += 16) {
+		// max() returns its second operand for NaN, which saturates NaN low
+		__m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), lo), hi);
+		__m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale), lo), hi);
+		__m256i p = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+		// packs works per 128 bit lane, giving a0 b0 a1 b1
+		p = _mm256_permute4x64_epi64(p, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i*) (dest + i), p);
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static int float_to_int_avx2(float const *src, int32_t *dest, int len, float N) {
+	const __m256 scale = _mm256_set1_ps(N);
+	const __m256 lo = _mm256_set1_ps(-N);
+	const __m256 hi = _mm256_set1_ps(N - 1);
+	int i = 0;
+	for (; i + 8 <= len; i += 8) {
+		__m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), lo), hi);
+		_mm256_storeu_si256((__m256i*) (dest + i), _mm256_cvtps_epi32(a));
+	}
+	return i;
+}
+#endif
+
+// Vectorized part of the conversion. Returns the number of samples done; the caller finishes the tail.
+static int float_to_short_simd(float const *src, short *dest, int len) {
+#ifdef PCM_AVX2_DISPATCH
+	if (haveAVX2())
+		return float_to_short_avx2(src, dest, len);
+#endif
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128 scale = _mm_set1_ps(32768.f);
+	const __m128 lo = _mm_set1_ps(-32768.f);
+	const __m128 hi = _mm_set1_ps(32767.f);
+	for (; i + 8 <= len; i += 8) {
+		__m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), lo), hi);
+		__m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), lo), hi);
+		_mm_storeu_si128((__m128i*) (dest + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+	}
+#elif defined(PCM_NEON)
+	const float32x4_t scale = vdupq_n_f32(32768.f);
+	const float32x4_t lo = vdupq_n_f32(-32768.f);
+	const float32x4_t hi = vdupq_n_f32(32767.f);
+	for (; i + 8 <= len; i += 8) {
+		// maxnm() returns the number when the other operand is NaN
+		float32x4_t a = vminq_f32(vmaxnmq_f32(vmulq_f32(vld1q_f32(src + i), scale), lo), hi);
+		float32x4_t b = vminq_f32(vmaxnmq_f32(vmulq_f32(vld1q_f32(src + i + 4), scale), lo), hi);
+		vst1q_s16(dest + i, vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)), vqmovn_s32(vcvtnq_s32_f32(b))));
+	}
+#endif
+	return i;
+}
+
+static int float_to_int_simd(float const *src, int32_t *dest, int len, float N) {
+#ifdef PCM_AVX2_DISPATCH
+	if (haveAVX2())
+		return float_to_int_avx2(src, dest, len, N);
+#endif
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128 scale = _mm_set1_ps(N);
+	const __m128 lo = _mm_set1_ps(-N);
+	const __m128 hi = _mm_set1_ps(N - 1);
+	for (; i + 4 <= len; i += 4) {
+		__m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), lo), hi);
+		_mm_storeu_si128((__m128i*) (dest + i), _mm_cvtps_epi32(a));
+	}
+#elif defined(PCM_NEON)
+	const float32x4_t scale = vdupq_n_f32(N);
+	const float32x4_t lo = vdupq_n_f32(-N);
+	const float32x4_t hi = vdupq_n_f32(N - 1);
+	for (; i + 4 <= len; i += 4) {
+		float32x4_t a = vminq_f32(vmaxnmq_f32(vmulq_f32(vld1q_f32(src + i), scale), lo), hi);
+		vst1q_s32(dest + i, vcvtnq_s32_f32(a));
+	}
+#endif
+	return i;
+}
+
+void src_float_to_short_array(float const *src, short *dest, int len) {
+	assert(src && dest);
+	int i = float_to_short_simd(src, dest, len);
+	for (; i < len; i++)
+		dest[i] = (short) quantize(src[i] * 32768.f, 32768.f);
+}
+
+void src_float_to_int24_array(float const *src, unsigned char *dest, int len) {
+	assert(src && dest);
+	// Quantize a block at a time into 32 bit integers, then pack to 3 bytes.
+	int32_t block[256];
+	for (int start = 0; start < len; start += 256) {
+		int n = len - start < 256 ? len - start : 256;
+		int i = float_to_int_simd(src + start, block, n, 8388608.f);
+		for (; i < n; i++)
+			block[i] = quantize(src[start + i] * 8388608.f, 8388608.f);
+		unsigned char *p = dest + 3 * start;
+		for (i = 0; i < n; i++) {
+			p[3*i] = (unsigned char) block[i];
+			p[3*i + 1] = (unsigned char) (block[i] >> 8);
+			p[3*i + 2] = (unsigned char) (block[i] >> 16);
+		}
+	}
+}
+
+// Float WAV keeps the engine's headroom, so samples are not clipped.
+void src_float_to_float32_array(float const *src, float *dest, int len) {
+	assert(src && dest);
+	memcpy(dest, src, len * sizeof(float));
+}
+
+// Uniform random number in [-0.5, 0.5) LSB, from a 32 bit LCG.
+static inline float ditherNoise(uint32_t &seed) {
+	seed = seed * 196314165 + 907633515;
+	return (int32_t) seed * (1.f / 4294967296.f);
+}
+
+// Dithered conversion is scalar: every sample depends on the generator state, and with noise
+// shaping also on the previous error of its channel.
+template <typename Store>
+static void quantizeDithered(float const *src, int numFrames, int numChannels, float N, PCMDither *dither, Store store) {
+	assert(numChannels <= PCM_MAX_CHANNELS);
+	bool shaped = (dither->mode == PCM_DITHER_SHAPED);
+	uint32_t seed = dither->seed;
+	int i = 0;
+	for (int f = 0; f < numFrames; f++) {
+		for (int c = 0; c < numChannels; c++, i++) {
+			float v = src[i] * N;
+			if (shaped)
+				v -= dither->error[c];
+			int32_t q = quantize(v + ditherNoise(seed) + ditherNoise(seed), N);
+			if (shaped) {
+				// Bound the fed back error, which grows without limit while the signal clips.
+				float e = q - v;
+				dither->error[c] = e > 2.f ? 2.f : e < -2.f ? -2.f : e;
+			}
+			store(i, q);
+		}
+	}
+	dither->seed = seed;
+}
+
+size_t pcmConvert(int sampleFormat, float const *src, unsigned char *dest, int numFrames, int numChannels, PCMDither *dither) {
+	int len = numFrames * numChannels;
+	bool dithered = dither && dither->mode != PCM_DITHER_NONE;
+	switch (sampleFormat) {
+		case WAV_SAMPLE_INT24:
+			if (dithered) {
+				quantizeDithered(src, numFrames, numChannels, 8388608.f, dither, [dest](int i, int32_t q) {
+					dest[3*i] = (unsigned char) q;
+					dest[3*i + 1] = (unsigned char) (q >> 8);
+					dest[3*i + 2] = (unsigned char) (q >> 16);
+				});
+			}
+			else {
+				src_float_to_int24_array(src, dest, len);
+			}
+			break;
+		case WAV_SAMPLE_FLOAT32:
+			src_float_to_float32_array(src, reinterpret_cast<float*>(dest), len);
+			break;
+		default:
+			if (dithered) {
+				short *out = reinterpret_cast<short*>(dest);
+				quantizeDithered(src, numFrames, numChannels, 32768.f, dither, [out](int i, int32_t q) {
+					out[i] = (short) q;
+				});
+			}
+			else {
+				src_float_to_short_array(src, reinterpret_cast<short*>(dest), len);
+			}
+			break;
+	}
+	return (size_t) len * pcmBytesPerSample(sampleFormat);
+}
+
+// Benchmark and bit-exactness check: the undithered conversions against the code they
+// replaced, the x87 fistp loop for 16-bit and the scalar lrintf loop for 24-bit, on random
+// samples in and out of range, NaN, +/-Inf and every block tail length. Then the speed of
+// the 16-bit conversion, old against new.
+// Build with -I../portaudio, on x86 (the old loop is x87 asm), with and without -mavx2.
+#if 0
+#include <chrono>
+#include <climits>
+#include <vector>
+
+#define rint16D(a,b) __asm__ __volatile__("fistps %0": "=m"(a): "t"(b): "st")
+
+static __inline int16_t rint16(double input) {
+	int16_t result; rint16D(result, input); return result;}
+
+static void old_float_to_short_array(float const *src, short *dest, int len) {
+	double d, N = 1. + SHRT_MAX;
+	while (len--) d = src[len] * N, dest[len] =
+		(short)(d > N - 1? (short)(N - 1) : d < -N? (short)-N : rint16(d));
+}
+
+static void old_float_to_int24_array(float const *src, unsigned char *dest, int len) {
+	const float N = 8388608.f;
+	for (int i = 0; i < len; i++) {
+		float d = src[i] * N;
+		d = d > N - 1 ? N - 1 : d < -N ? -N : d;
+		int32_t v = (int32_t) lrintf(d);
+		dest[3*i] = (unsigned char) v;
+		dest[3*i + 1] = (unsigned char) (v >> 8);
+		dest[3*i + 2] = (unsigned char) (v >> 16);
+	}
+}
+
+int main() {
+	const int len = 1 << 16;
+	std::vector<float> src(len);
+	uint32_t seed = 1;
+	for (int i = 0; i < len; i++) {
+		seed = seed * 1664525u + 1013904223u;
+		// Mostly [-1.5, 1.5], with exact half LSB ties and the special values mixed in
+		float x = ((int32_t) seed) * (1.5f / 2147483648.f);
+		switch (seed >> 28) {
+			case 0: x = NAN; break;
+			case 1: x = (seed & 1) ? INFINITY : -INFINITY; break;
+			case 2: x = ((int32_t) (seed >> 8) % 65536 + 0.5f) / 32768.f; break;
+			default: break;
+		}
+		src[i] = x;
+	}
+
+	// Every length up to 40 covers all tails of the 4, 8 and 16 sample blocks, and
+	// the odd offsets misalign the loads; the last length is the whole buffer.
+	// Counts the samples that differ.
+	int shortErrors = 0, int24Errors = 0, int24NaN = 0;
+	std::vector<short> oldShort(len), newShort(len);
+	std::vector<unsigned char> old24(3 * len), new24(3 * len);
+	for (int length = 0; length <= 41; length++) {
+		for (int offset = 0; offset < 3; offset++) {
+			int n = length <= 40 ? length : len - offset;
+			old_float_to_short_array(&src[offset], &oldShort[0], n);
+			pcmConvert(WAV_SAMPLE_INT16, &src[offset], (unsigned char*) &newShort[0], n, 1, NULL);
+			old_float_to_int24_array(&src[offset], &old24[0], n);
+			pcmConvert(WAV_SAMPLE_INT24, &src[offset], &new24[0], n, 1, NULL);
+			for (int i = 0; i < n; i++) {
+				shortErrors += oldShort[i] != newShort[i];
+				if (memcmp(&old24[3*i], &new24[3*i], 3) != 0) {
+					// lrintf(NaN) is unspecified; x86 gives INT_MIN, which the old loop
+					// truncated to 0. The new code saturates NaN low, as fistp did for 16-bit.
+					if (src[offset + i] != src[offset + i])
+						int24NaN++;
+					else
+						int24Errors++;
+				}
+			}
+		}
+	}
+	printf("16-bit: %d samples differ\n", shortErrors);
+	printf("24-bit: %d samples differ, %d NaN samples now -full scale instead of 0\n", int24Errors, int24NaN);
+
+	// Speed on in-range samples only
+	for (int i = 0; i < len; i++)
+		src[i] = sinf(0.001f * i);
+	const int rounds = 2000;
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++)
+		old_float_to_short_array(&src[0], &oldShort[0], len);
+	std::chrono::duration<double> before = std::chrono::steady_clock::now() - start;
+	start = std::chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++)
+		pcmConvert(WAV_SAMPLE_INT16, &src[0], (unsigned char*) &newShort[0], len / 2, 2, NULL);
+	std::chrono::duration<double> after = std::chrono::steady_clock::now() - start;
+	printf("16-bit: fistp loop %.2f ns/sample, pcmConvert %.2f ns/sample (%.1fx)\n",
+		1e9 * before.count() / ((double) rounds * len), 1e9 * after.count() / ((double) rounds * len),
+		before.count() / after.count());
+	return 0;
+}
+#endif
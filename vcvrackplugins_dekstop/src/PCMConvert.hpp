@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Conversion of the engine's float samples to WAV sample data, run on the recorder writer threads.
+// Sample formats are the WAV_SAMPLE_* constants from write_wav.h. Rack only targets little endian
+// hosts, so the output can be handed to Audio_WAV_WriteBytes() as is.
+
+enum PCMDitherMode {
+	PCM_DITHER_NONE,
+	// Triangular (TPDF) dither of +/- 1 LSB, which decorrelates the quantization error from the signal.
+	PCM_DITHER_TPDF,
+	// TPDF dither plus first order error feedback, which moves the noise towards high frequencies.
+	PCM_DITHER_SHAPED,
+};
+
+#define PCM_MAX_CHANNELS 32
+
+/** Dither state of one interleaved stream. Only used by integer sample formats. */
+struct PCMDither {
+	int mode = PCM_DITHER_NONE;
+	uint32_t seed = 22222;
+	float error[PCM_MAX_CHANNELS] = {};
+
+	void reset() {
+		seed = 22222;
+		for (int c = 0; c < PCM_MAX_CHANNELS; c++)
+			error[c] = 0.f;
+	}
+};
+
+/** Size of one sample in bytes in the given WAV_SAMPLE_* format. */
+int pcmBytesPerSample(int sampleFormat);
+
+/** Converts `numFrames` interleaved frames of `numChannels` samples in [-1, 1] to `sampleFormat`.
+Out of range samples saturate. `dither` may be NULL, which is the same as PCM_DITHER_NONE.
+Returns the number of bytes written to `dest`.
+*/
+size_t pcmConvert(int sampleFormat, float const *src, unsigned char *dest, int numFrames, int numChannels, PCMDither *dither);
+
+/** Round to nearest (ties to even) and saturate, using SSE2, AVX2 or NEON where available.
+The output is bit-identical to the scalar version on all paths, NaN included (which becomes the negative limit).
+*/
+void src_float_to_short_array(float const *src, short *dest, int len);
+void src_float_to_int24_array(float const *src, unsigned char *dest, int len);
+void src_float_to_float32_array(float const *src, float *dest, int len);
@@ -0,0 +1,1287 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <time.h>
+
+#include "dekstop.hpp"
+#include "../dep/osdialog/osdialog.h"
+#include "write_wav.h"
+#include "PCMConvert.hpp"
+#include "FLACWriter.hpp"
+#include "OverviewWriter.hpp"
+#include "dsp/digital.hpp"
+#include "dsp/frame.hpp"
+#include "SPSCRingBuffer.hpp"
+#include "RecorderService.hpp"
+#include "RecorderClock.hpp"
+#include "Resampler.hpp"
+
+#define BLOCKSIZE 1024
+#define MINBUFFERSIZE (8*BLOCKSIZE)
+#define MAXBUFFERBYTES (256*1024*1024) // ring buffer memory limit, whatever the channel count
+#define MAXBUFFERGROWTH 3 // times the ring buffer can double after recordings that dropped frames
+#define WRITESIZE (4*BLOCKSIZE) // frames converted per write call
+#define MAXDROPOUTS 256 // dropouts that can be waiting for the writer thread to mark them
+#define IDLETIMEOUT 0.5f // seconds between checks for sample rate changes while not recording
+#define RAMFALLBACK 0.9f // RAM arena use at which a take starts streaming to disk after all
+#define HEADERREFRESH 1.f // seconds of audio between WAV header updates, which is what a crash can lose
+
+enum RecorderChannelMode {
+	// One file with every input, connected or not
+	RECORD_ALL_INPUTS,
+	// One interleaved file with the inputs that are patched when the recording starts
+	RECORD_CONNECTED_INPUTS,
+	// One mono file per patched input, named after the input number
+	RECORD_CONNECTED_STEMS,
+};
+
+enum RecorderFileType {
+	RECORDER_FILE_WAV,
+	// Lossless, half the size of WAV or less. 16-bit and 24-bit only, and up to 8 channels per file.
+	RECORDER_FILE_FLAC,
+};
+
+enum RecorderWriteMode {
+	// Samples are copied into a block buffer that is written out with one write call per block
+	RECORDER_WRITE_BUFFERED,
+	// Samples are converted straight into mapped pages of the file. Linux only, otherwise buffered.
+	RECORDER_WRITE_MAPPED,
+};
+
+/** Takes go through these states in order. The writer moves from FINISHING to READY.
+Only step() leaves READY: to RECORDING, or back to PREPARING when the writer thread asks for it.
+Only step() moves from RECORDING to FINISHING.
+*/
+enum RecorderState {
+	// The writer thread is sizing the ring buffer for the next take
+	RECORDER_PREPARING,
+	// The ring buffer is empty and the writer thread waits for a take, while step() fills the pre-roll
+	RECORDER_READY,
+	// step() pushes frames, the writer thread opens the files and writes them
+	RECORDER_RECORDING,
+	// step() pushed its last frame, the writer thread flushes and closes the files
+	RECORDER_FINISHING,
+};
+
+/** A run of frames step() could not push because the ring buffer was full. */
+struct RecorderDropout {
+	unsigned long long frame; // position of the gap in the recorded file
+	unsigned int numFrames;
+};
+
+template <unsigned int ChannelCount>
+struct Recorder : Module, RecorderStream {
+	enum ParamIds {
+		RECORD_PARAM,
+		NUM_PARAMS
+	};
+	enum InputIds {
+		AUDIO1_INPUT,
+		GATE_INPUT = AUDIO1_INPUT + ChannelCount,
+		NUM_INPUTS
+	};
+	enum OutputIds {
+		NUM_OUTPUTS
+	};
+	enum LightIds {
+		RECORDING_LIGHT,
+		DROPOUT_LIGHT,
+		LEVEL1_LIGHT,
+		NUM_LIGHTS = LEVEL1_LIGHT + ChannelCount
+	};
+
+	int fileType = RECORDER_FILE_WAV;
+	int sampleFormat = WAV_SAMPLE_INT16;
+	int ditherMode = PCM_DITHER_NONE;
+	int channelMode = RECORD_ALL_INPUTS;
+	int bufferLatency = 1000; // ring buffer length in ms, before growth
+	int writeMode = RECORDER_WRITE_BUFFERED; // of WAV files
+	int preRoll = 0; // seconds of audio from before the start of each take, 0 for none
+	int sync = 0; // start and stop with the other synchronized recorders, through recorderClock
+	int ramCapture = 0; // MB of RAM arena that takes are captured into and written from after they stop, 0 to stream
+	int outputRate = 0; // sample rate of the files in Hz, 0 for the engine sample rate
+	unsigned int bufferGrowth = 0; // doublings of the ring buffer after recordings that dropped frames
+	float sampleRate = 44100.f; // of the current recording
+	float fileRate = 44100.f; // of the files of the current recording, writer thread only
+	std::atomic<int> takeNumber;
+
+	// File names are shared by the UI thread and the writer thread.
+	std::mutex filenameMutex;
+	std::string outputDirectory; // takes are named after filenameTemplate in here; empty to ask for each take
+	std::string filenameTemplate = "{patch}_{timestamp}";
+	std::string requestedFilename; // from the save dialog, for the next take
+	std::string lastFilename; // of the current or last take
+	std::string patchPath; // copied from the RackWidget by the module widget
+
+	// Start and stop requests from the record button or the gate input, carried out by step().
+	std::atomic_bool startRequested;
+	std::atomic_bool stopRequested;
+	std::atomic_bool prepareRequested; // by the writer thread, to resize the buffers between takes
+	std::atomic<int> state;
+	bool gateHigh = false;
+
+	// Fixed for the length of a take. step() packs the recorded inputs into the first
+	// numChannels samples of each frame, in the order of channelMap.
+	unsigned int channelMap[ChannelCount];
+	unsigned int numChannels = 0;
+	std::atomic<unsigned long long> takeStartFrame; // recorderClock frame of the first frame in the files, pre-roll included
+	std::atomic<long long> takeStartTime; // wall-clock time_t of the first frame in the files, for the file name and bext
+	WAV_Writer writers[ChannelCount]; // one per stem, otherwise only the first is used
+	FLACWriter flacWriters[ChannelCount]; // used instead of writers for FLAC takes
+	OverviewWriter overviews[ChannelCount]; // peak and RMS sidecar of each file, if it could be opened
+	unsigned int numWriters = 0;
+	bool flacTake = false; // writer thread only
+	int takeSampleFormat = WAV_SAMPLE_INT16; // writer thread only
+	PCMDither dither[ChannelCount]; // writer thread state, one per file
+	Resampler resampler; // writer thread only, from sampleRate to fileRate
+	bool resampling = false; // writer thread only
+
+	// The writer is a stream of the process-wide recorderService, whose worker threads record one
+	// take after another. The "writer thread" of a module is whichever worker services it; only
+	// one does at a time.
+	bool filesOpen = false; // writer thread only
+	bool takeFailed = false; // writer thread only
+	float preparedSampleRate = 0.f; // writer thread only
+	int preparedPreRoll = 0; // writer thread only
+	int preparedRamCapture = 0; // writer thread only
+	bool deferredTake = false; // writer thread only, the take is captured into the RAM arena
+	std::atomic_bool deferring; // no disk writes until the take stops or the arena is nearly full
+	std::atomic<unsigned int> wakeupInterval; // frames between wakeups of the service by step(), adjusted by the writer thread
+	unsigned int framesSinceWakeup = 0;
+	SPSCRingBuffer<Frame<ChannelCount>> buffer; // allocated by the writer thread between takes
+	std::atomic<size_t> bufferCapacity; // of the ring buffer, for the other threads
+	unsigned int packedLayout[ChannelCount]; // where writeFrames() finds each channel in ring buffer frames
+
+	// Pre-roll of all inputs, written by step() while READY and frozen while a take writes it out
+	// ahead of the ring buffer. Allocated by the writer thread between takes.
+	std::vector<Frame<ChannelCount>> history;
+	size_t historyPos = 0; // next frame to overwrite
+	size_t historyFrames = 0; // frames of pre-roll, up to history.size()
+
+	// Telemetry of the current or last take. The step() counters are reset when a take starts,
+	// the writer thread ones when it opens the files.
+	std::atomic<unsigned long long> droppedFrames;
+	std::atomic<unsigned int> numDropouts;
+	std::atomic<float> longestStall; // longest single drain of the ring buffer, in seconds
+	std::atomic<size_t> peakOccupancy; // most frames waiting in the ring buffer at a writer wakeup
+	std::atomic<float> levels[ChannelCount]; // meter brightness of each input, set from the overviews by the writer thread
+	unsigned long long capturedFrames = 0; // audio thread only
+	unsigned int dropoutFrames = 0; // audio thread only, length of the dropout in progress
+	SPSCRingBuffer<RecorderDropout> dropouts{MAXDROPOUTS};
+
+	float gatherBuffer[ChannelCount*WRITESIZE];
+	float resampleBuffer[ChannelCount*WRITESIZE];
+	float stemBuffer[WRITESIZE];
+	unsigned char writeBuffer[4*ChannelCount*WRITESIZE]; // room for the widest sample format
+
+	Recorder() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS)
+	{
+		takeNumber = 1;
+		takeStartFrame = 0;
+		takeStartTime = 0;
+		startRequested = false;
+		stopRequested = false;
+		prepareRequested = false;
+		state = RECORDER_PREPARING;
+		wakeupInterval = MINBUFFERSIZE / 8;
+		bufferCapacity = MINBUFFERSIZE;
+		droppedFrames = 0;
+		numDropouts = 0;
+		longestStall = 0.f;
+		peakOccupancy = 0;
+		deferring = false;
+		for (unsigned int i = 0; i < ChannelCount; i++) {
+			packedLayout[i] = i;
+			levels[i] = 0.f;
+		}
+		recorderService.add(this);
+		recorderClock.add(this);
+	}
+	~Recorder();
+	void step() override;
+	json_t *toJson() override;
+	void fromJson(json_t *rootJ) override;
+	bool isRecording() const {
+		return state == RECORDER_RECORDING;
+	}
+	void startRecording();
+	void stopRecording();
+	bool selectChannels();
+	std::string saveAsDialog();
+	std::string takeFilename(time_t startTime);
+	std::string stemFilename(const std::string &path, unsigned int channel);
+	std::string overviewFilename(const std::string &path);
+	size_t chooseBufferSize();
+	void prepareTake();
+	bool openFiles();
+	void closeFiles();
+	float service() override;
+	float urgency() override;
+	bool writeBufferedFrames();
+	bool writeHistory();
+	bool writeFrames(Frame<ChannelCount> *frames, size_t numFrames, const unsigned int *layout);
+	bool writePacked(const float *frames, size_t numFrames);
+	void updateLevels();
+	void writeDropoutMarkers();
+};
+
+template <unsigned int ChannelCount>
+Recorder<ChannelCount>::~Recorder() {
+	recorderClock.remove(this);
+	recorderService.remove(this);
+	// The engine no longer calls step() here, so a take in progress won't be stopped. Write what
+	// it captured on this thread.
+	int s = state;
+	if ((s == RECORDER_RECORDING || s == RECORDER_FINISHING) && !filesOpen && !takeFailed) {
+		filesOpen = openFiles() && writeHistory();
+	}
+	if (filesOpen) {
+		writeBufferedFrames();
+		closeFiles();
+		filesOpen = false;
+	}
+}
+
+template <unsigned int ChannelCount>
+json_t *Recorder<ChannelCount>::toJson() {
+	json_t *rootJ = json_object();
+	json_object_set_new(rootJ, "fileType", json_integer(fileType));
+	json_object_set_new(rootJ, "sampleFormat", json_integer(sampleFormat));
+	json_object_set_new(rootJ, "dither", json_integer(ditherMode));
+	json_object_set_new(rootJ, "channelMode", json_integer(channelMode));
+	json_object_set_new(rootJ, "bufferLatency", json_integer(bufferLatency));
+	json_object_set_new(rootJ, "writeMode", json_integer(writeMode));
+	json_object_set_new(rootJ, "preRoll", json_integer(preRoll));
+	json_object_set_new(rootJ, "sync", json_integer(sync));
+	json_object_set_new(rootJ, "ramCapture", json_integer(ramCapture));
+	json_object_set_new(rootJ, "outputRate", json_integer(outputRate));
+	json_object_set_new(rootJ, "take", json_integer(takeNumber));
+	std::lock_guard<std::mutex> lock(filenameMutex);
+	json_object_set_new(rootJ, "directory", json_string(outputDirectory.c_str()));
+	json_object_set_new(rootJ, "filenameTemplate", json_string(filenameTemplate.c_str()));
+	return rootJ;
+}
+
+template <unsigned int ChannelCount>
+void Recorder<ChannelCount>::fromJson(json_t *rootJ) {
+	json_t *fileTypeJ = json_object_get(rootJ, "fileType");
+	if (fileTypeJ) {
+		fileType = json_integer_value(fileTypeJ);
+	}
+	json_t *sampleFormatJ = json_object_get(rootJ, "sampleFormat");
+	if (sampleFormatJ) {
+		sampleFormat = json_integer_value(sampleFormatJ);
+	}
+	json_t *ditherJ = json_object_get(rootJ, "dither");
+	if (ditherJ) {
+		ditherMode = json_integer_value(ditherJ);
+	}
+	json_t *channelModeJ = json_object_get(rootJ, "channelMode");
+	if (channelModeJ) {
+		channelMode = json_integer_value(channelModeJ);
+	}
+	json_t *bufferLatencyJ = json_object_get(rootJ, "bufferLatency");
+	if (bufferLatencyJ) {
+		bufferLatency = json_integer_value(bufferLatencyJ);
+	}
+	json_t *writeModeJ = json_object_get(rootJ, "writeMode");
+	if (writeModeJ) {
+		writeMode = json_integer_value(writeModeJ);
+	}
+	json_t *preRollJ = json_object_get(rootJ, "preRoll");
+	if (preRollJ) {
+		preRoll = json_integer_value(preRollJ);
+	}
+	json_t *syncJ = json_object_get(rootJ, "sync");
+	if (syncJ) {
+		sync = json_integer_value(syncJ);
+	}
+	json_t *ramCaptureJ = json_object_get(rootJ, "ramCapture");
+	if (ramCaptureJ) {
+		ramCapture = json_integer_value(ramCaptureJ);
+	}
+	json_t *outputRateJ = json_object_get(rootJ, "outputRate");
+	if (outputRateJ) {
+		outputRate = json_integer_value(outputRateJ);
+	}
+	json_t *takeJ = json_object_get(rootJ, "take");
+	if (takeJ) {
+		takeNumber = json_integer_value(takeJ);
+	}
+	std::lock_guard<std::mutex> lock(filenameMutex);
+	json_t *directoryJ = json_object_get(rootJ, "directory");
+	if (directoryJ) {
+		outputDirectory = json_string_value(directoryJ);
+	}
+	json_t *filenameTemplateJ = json_object_get(rootJ, "filenameTemplate");
+	if (filenameTemplateJ) {
+		filenameTemplate = json_string_value(filenameTemplateJ);
+	}
+}
+
+// Called by the record button. Without an output directory, asks for the file name first.
+template <unsigned int ChannelCount>
+void Recorder<ChannelCount>::startRecording() {
+	bool connected = (channelMode == RECORD_ALL_INPUTS);
+	for (unsigned int i = 0; i < ChannelCount; i++) {
+		connected = connected || inputs[AUDIO1_INPUT + i].active;
+	}
+	if (!connected) {
+		osdialog_message(OSDIALOG_INFO, OSDIALOG_OK, "No inputs are connected, so there is nothing to record.");
+		return;
+	}
+	bool ask;
+	{
+		std::lock_guard<std::mutex> lock(filenameMutex);
+		ask = outputDirectory.empty();
+	}
+	if (ask) {
+		std::string path = saveAsDialog();
+		if (path.empty())
+			return;
+		std::lock_guard<std::mutex> lock(filenameMutex);
+		requestedFilename = path;
+	}
+	// Synchronized recorders all start in the next engine frame, the others with a file name from
+	// the template, like gate-started takes.
+	if (sync)
+		recorderClock.requestStart();
+	else
+		startRequested = true;
+}
+
+template <unsigned int ChannelCount>
+void Recorder<ChannelCount>::stopRecording() {
+	if (sync)
+		recorderClock.requestStop();
+	else
+		stopRequested = true;
+}
+
+// Returns the chosen path, or an empty string if the dialog was cancelled.
+template <unsigned int ChannelCount>
+std::string Recorder<ChannelCount>::saveAsDialog() {
+	std::string dir, name;
+	{
+		std::lock_guard<std::mutex> lock(filenameMutex);
+		dir = lastFilename.empty() ? "." : extractDirectory(lastFilename);
+	}
+	name = takeFilename(time(NULL));
+	name = name.substr(name.find_last_of("/\\") + 1);
+	char *path = osdialog_file(OSDIALOG_SAVE, dir.c_str(), name.c_str(), NULL);
+	if (!path)
+		return "";
+	std::string filename = path;
+	free(path);
+	return filename;
+}
+
+// Expands the {patch}, {timestamp} and {take} tokens of the file name template, in the output
+// directory, with the take starting at startTime. Takes started by the gate input without an output
+// directory go next to the last take.
+template <unsigned int ChannelCount>
+std::string Recorder<ChannelCount>::takeFilename(time_t startTime) {
+	std::lock_guard<std::mutex> lock(filenameMutex);
+
+	std::string patch = patchPath.substr(patchPath.find_last_of("/\\") + 1);
+	patch = patch.substr(0, patch.find_last_of('.'));
+	if (patch.empty())
+		patch = "untitled";
+
+	char timestamp[32];
+	struct tm local;
+#ifdef _WIN32
+	localtime_s(&local, &startTime);
+#else
+	localtime_r(&startTime, &local);
+#endif
+	strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", &local);
+
+	const std::pair<std::string, std::string> tokens[] = {
+		{"{patch}", patch},
+		{"{timestamp}", timestamp},
+		{"{take}", stringf("%03d", takeNumber.load())},
+	};
+	std::string name = filenameTemplate;
+	for (const auto &token : tokens) {
+		size_t pos;
+		while ((pos = name.find(token.first)) != std::string::npos) {
+			name.replace(pos, token.first.size(), token.second);
+		}
+	}
+
+	std::string dir = outputDirectory;
+	if (dir.empty())
+		dir = lastFilename.empty() ? "." : extractDirectory(lastFilename);
+	return dir + "/" + name + (fileType == RECORDER_FILE_FLAC ? ".flac" : ".wav");
+}
+
+// Decide which inputs go into the take. Returns false if there is nothing to record.
+// Called by step() when a take starts.
+template <unsigned int ChannelCount>
+bool Recorder<ChannelCount>::selectChannels() {
+	numChannels = 0;
+	for (unsigned int i = 0; i < ChannelCount; i++) {
+		if (channelMode == RECORD_ALL_INPUTS || inputs[AUDIO1_INPUT + i].active) {
+			channelMap[numChannels++] = i;
+		}
+	}
+	numWriters = (channelMode == RECORD_CONNECTED_STEMS) ? numChannels : 1;
+	return numChannels > 0;
+}
+
+// "Take.wav" becomes "Take_3.wav" for the stem of input 3.
+template <unsigned int ChannelCount>
+std::string Recorder<ChannelCount>::stemFilename(const std::string &path, unsigned int channel) {
+	size_t dot = path.find_last_of('.');
+	size_t separator = path.find_last_of("/\\");
+	if (dot == std::string::npos || (separator != std::string::npos && dot < separator))
+		dot = path.size();
+	return path.substr(0, dot) + stringf("_%d", channel + 1) + path.substr(dot);
+}
+
+// "Take_3.wav" has its overview in "Take_3.peaks".
+template <unsigned int ChannelCount>
+std::string Recorder<ChannelCount>::overviewFilename(const std::string &path) {
+	size_t dot = path.find_last_of('.');
+	size_t separator = path.find_last_of("/\\");
+	if (dot == std::string::npos || (separator != std::string::npos && dot < separator))
+		dot = path.size();
+	return path.substr(0, dot) + ".peaks";
+}
+
+// Enough ring buffer for bufferLatency ms of audio, doubled for every recording that dropped
+// frames, in powers of 2 up to MAXBUFFERBYTES.
+template <unsigned int ChannelCount>
+size_t Recorder<ChannelCount>::chooseBufferSize() {
+	if (deferredTake) {
+		// The largest power of 2 that fits the RAM arena
+		unsigned long long maxFrames = (unsigned long long) ramCapture * 1024 * 1024 / sizeof(Frame<ChannelCount>);
+		size_t size = MINBUFFERSIZE;
+		while (2 * size <= maxFrames)
+			size *= 2;
+		return size;
+	}
+	size_t wanted = (size_t) (sampleRate * bufferLatency / 1000.f) << bufferGrowth;
+	size_t maxFrames = MAXBUFFERBYTES / sizeof(Frame<ChannelCount>);
+	size_t size = MINBUFFERSIZE;
+	while (size < wanted && 2 * size <= maxFrames)
+		size *= 2;
+	return size;
+}
+
+// Writer thread: get an empty ring buffer and pre-roll of the right size ready for the next take.
+template <unsigned int ChannelCount>
+void Recorder<ChannelCount>::prepareTake() {
+	sampleRate = engineGetSampleRate();
+	preparedSampleRate = sampleRate;
+	preparedPreRoll = preRoll;
+	preparedRamCapture = ramCapture;
+	deferredTake = (ramCapture > 0);
+	if (deferredTake) {
+		// The arena is zeroed by the allocation here, so no page is first touched by step().
+		try {
+			buffer.resize(chooseBufferSize());
+		}
+		catch (std::bad_alloc &) {
+			fprintf(stderr, "Could not allocate the RAM arena of %d MB, streaming takes to disk instead.\n", ramCapture);
+			deferredTake = false;
+		}
+	}
+	if (!deferredTake)
+		buffer.resize(chooseBufferSize());
+	deferring = deferredTake;
+	bufferCapacity = buffer.capacity;
+	// A deferred take only looks at the arena use on wakeups, which must come often enough to fall back
+	// to streaming in time.
+	wakeupInterval = buffer.capacity / (deferredTake ? 64 : 8);
+
+	size_t historySize = std::min((size_t) (std::max(preRoll, 0) * sampleRate), MAXBUFFERBYTES / sizeof(Frame<ChannelCount>));
+	if (history.size() != historySize) {
+		std::vector<Frame<ChannelCount>>(historySize).swap(history);
+	}
+	historyPos = 0;
+	historyFrames = 0;
+	prepareRequested = false;
+
+	dropouts.clear();
+	takeFailed = false;
+	state = RECORDER_READY;
+}
+
+template <unsigned int ChannelCount>
+bool Recorder<ChannelCount>::openFiles() {
+	std::string filename;
+	{
+		std::lock_guard<std::mutex> lock(filenameMutex);
+		filename.swap(requestedFilename);
+	}
+	// Deferred takes open their files after they stop, so the time comes from the start of the take.
+	time_t startTime = (time_t) takeStartTime.load();
+	if (filename.empty())
+		filename = takeFilename(startTime);
+	{
+		std::lock_guard<std::mutex> lock(filenameMutex);
+		lastFilename = filename;
+	}
+	takeNumber++;
+
+	sampleRate = engineGetSampleRate();
+	longestStall = 0.f;
+
+	// All recorded channels are converted together, before they are split into stems. The output of
+	// each resampler call has to fit in resampleBuffer.
+	fileRate = (outputRate > 0) ? outputRate : sampleRate;
+	resampling = (fileRate != sampleRate);
+	if (resampling) {
+		size_t maxInput = std::min((size_t) WRITESIZE, (size_t) ((WRITESIZE - 1) * (double) sampleRate / fileRate));
+		if (resampler.init((int) sampleRate, (int) fileRate, numChannels, maxInput) < 0) {
+			fprintf(stderr, "Cannot convert %d Hz to %d Hz, recording at the engine sample rate instead.\n", (int) sampleRate, (int) fileRate);
+			fileRate = sampleRate;
+			resampling = false;
+		}
+	}
+
+	char date[16], timeOfDay[16];
+	struct tm local;
+#ifdef _WIN32
+	localtime_s(&local, &startTime);
+#else
+	localtime_r(&startTime, &local);
+#endif
+	strftime(date, sizeof(date), "%Y-%m-%d", &local);
+	strftime(timeOfDay, sizeof(timeOfDay), "%H:%M:%S", &local);
+	// In samples at the file rate, like the rest of the file
+	unsigned long long timeReference = (unsigned long long) (takeStartFrame * (double) fileRate / sampleRate);
+	// A deferred take opens its files with the arena use so far.
+	peakOccupancy = buffer.size();
+
+	// FLAC has no float samples and no more than 8 channels per file.
+	takeSampleFormat = sampleFormat;
+	flacTake = (fileType == RECORDER_FILE_FLAC);
+	if (flacTake && numWriters == 1 && numChannels > FLAC_MAX_CHANNELS) {
+		fprintf(stdout, "FLAC files hold up to %d channels, recording %d channels to WAV instead.\n", FLAC_MAX_CHANNELS, numChannels);
+		flacTake = false;
+	}
+	if (flacTake && takeSampleFormat == WAV_SAMPLE_FLOAT32)
+		takeSampleFormat = WAV_SAMPLE_INT24;
+
+	for (unsigned int i = 0; i < numWriters; i++) {
+		std::string path = (numWriters > 1) ? stemFilename(filename, channelMap[i]) : filename;
+		int channels = (numWriters > 1) ? 1 : numChannels;
+		fprintf(stdout, "Recording to %s\n", path.c_str());
+		long result = flacTake ?
+			flacWriters[i].open(path.c_str(), fileRate, channels, takeSampleFormat, timeReference) :
+			Audio_WAV_OpenWriterFormat(&writers[i], path.c_str(), fileRate, channels, takeSampleFormat);
+		if (result < 0) {
+			// Close the stems opened so far, so their handles are not leaked.
+			while (i > 0) {
+				if (flacTake)
+					flacWriters[--i].close();
+				else
+					Audio_WAV_CloseWriter(&writers[--i]);
+				overviews[i].close();
+			}
+			char msg[100];
+			snprintf(msg, sizeof(msg), "Failed to open the recording file, result = %ld\n", result);
+			osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, msg);
+			fprintf(stderr, "%s", msg);
+			return false;
+		}
+		// The start of the take on the engine frame clock shared by all recorders, so that editors
+		// line up the takes of recorders that started together.
+		if (!flacTake)
+			Audio_WAV_SetBroadcastInfo(&writers[i], "Recorded in VCV Rack. Time reference: Rack engine time.", "dekstop Recorder", date, timeOfDay, timeReference);
+		// Mapped files grow in large allocated steps anyway. Buffered files let the filesystem
+		// reserve space in large extents while we record.
+		if (!flacTake && (writeMode != RECORDER_WRITE_MAPPED || Audio_WAV_SetMemoryMapped(&writers[i]) < 0))
+			Audio_WAV_SetPreallocation(&writers[i], 16 * 1024 * 1024 / numWriters);
+		// Keep the header of WAV takes current, so a crash does not leave a file that claims to be empty.
+		if (!flacTake)
+			Audio_WAV_SetHeaderRefresh(&writers[i], (long) (HEADERREFRESH * fileRate) * writers[i].bytesPerFrame);
+		dither[i].reset();
+		dither[i].mode = ditherMode;
+
+		// The take goes on without its overview if that cannot be written.
+		result = overviews[i].open(overviewFilename(path).c_str(), fileRate, channels);
+		if (result < 0)
+			fprintf(stderr, "Failed to open the overview file, result = %ld\n", result);
+	}
+	return true;
+}
+
+template <unsigned int ChannelCount>
+void Recorder<ChannelCount>::closeFiles() {
+	fprintf(stdout, "Stopping the recording. %llu frames dropped in %u dropouts, longest write %.1f ms, peak buffer use %d%%\n",
+		droppedFrames.load(), numDropouts.load(), 1000.f * longestStall, (int) (100 * peakOccupancy / buffer.capacity));
+	// The end of the take is still in the resampler, unless writing has failed.
+	if (resampling && !takeFailed) {
+		size_t n;
+		while ((n = resampler.flush(resampleBuffer)) > 0 && writePacked(resampleBuffer, n)) {}
+	}
+	writeDropoutMarkers();
+	if (numDropouts > 0 && bufferGrowth < MAXBUFFERGROWTH) {
+		bufferGrowth++;
+		fprintf(stdout, "Doubling the recording buffer for the next recording.\n");
+	}
+	for (unsigned int i = 0; i < numWriters; i++) {
+		long result = flacTake ? flacWriters[i].close() : Audio_WAV_CloseWriter(&writers[i]);
+		if (result < 0) {
+			char msg[100];
+			snprintf(msg, sizeof(msg), "Failed to close the recording file, result = %ld\n", result);
+			osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, msg);
+			fprintf(stderr, "%s", msg);
+		}
+		if (overviews[i].close() < 0)
+			fprintf(stderr, "Failed to close the overview file\n");
+	}
+	for (unsigned int i = 0; i < ChannelCount; i++) {
+		levels[i] = 0.f;
+	}
+}
+
+// Called by the recorderService workers, one at a time.
+template <unsigned int ChannelCount>
+float Recorder<ChannelCount>::service() {
+	int s = state;
+	if (s == RECORDER_RECORDING && deferring) {
+		// Not even the files are opened while a deferred take records, unless the arena is about to fill.
+		size_t used = buffer.size();
+		if (used > peakOccupancy)
+			peakOccupancy = used;
+		if (used < RAMFALLBACK * buffer.capacity)
+			return 2.f * wakeupInterval / sampleRate;
+		fprintf(stdout, "The RAM arena is %d%% full, writing the rest of the take while recording.\n", (int) (100 * used / buffer.capacity));
+		deferring = false;
+	}
+	if (s == RECORDER_RECORDING || s == RECORDER_FINISHING) {
+		// step() has already captured the first frames of the take; open the files behind it.
+		if (!filesOpen && !takeFailed) {
+			filesOpen = openFiles();
+			takeFailed = !filesOpen;
+			if (filesOpen && !writeHistory()) {
+				takeFailed = true;
+				closeFiles();
+				filesOpen = false;
+			}
+		}
+		if (filesOpen && !writeBufferedFrames()) {
+			takeFailed = true;
+			closeFiles();
+			filesOpen = false;
+		}
+		if (takeFailed) {
+			// Discard frames until step() has seen the stop request.
+			stopRequested = true;
+			buffer.clear();
+		}
+		if (s == RECORDER_FINISHING) {
+			// step() switched to FINISHING after its last push, so the drain above got every frame.
+			if (filesOpen) {
+				closeFiles();
+				filesOpen = false;
+			}
+			state = RECORDER_PREPARING;
+			prepareTake();
+			return 0.f;
+		}
+	}
+	else if (s == RECORDER_PREPARING) {
+		// Creation, or step() gave up READY for a resize.
+		prepareTake();
+		return 0.f;
+	}
+	else if (engineGetSampleRate() != preparedSampleRate || preRoll != preparedPreRoll || ramCapture != preparedRamCapture) {
+		// Ask step() for the buffers, unless it starts a take first.
+		prepareRequested = true;
+	}
+
+	// step() wakes the service for a new block or a start or stop. The timeout is only a
+	// fallback for when the engine stops calling step() in the middle of a take.
+	// A writer that fell behind comes back right away until the ring buffer is below half full.
+	if (s != RECORDER_RECORDING)
+		return IDLETIMEOUT;
+	if (buffer.size() >= buffer.capacity / 2)
+		return 0.f;
+	return 2.f * wakeupInterval / sampleRate;
+}
+
+// Called by the recorderService workers while another one may be servicing the module.
+template <unsigned int ChannelCount>
+float Recorder<ChannelCount>::urgency() {
+	int s = state;
+	if ((s != RECORDER_RECORDING && s != RECORDER_FINISHING) || (s == RECORDER_RECORDING && deferring))
+		return 0.f;
+	return (float) buffer.size() / bufferCapacity;
+}
+
+// Drain the ring buffer in contiguous spans, up to two per call when the readable region wraps.
+template <unsigned int ChannelCount>
+bool Recorder<ChannelCount>::writeBufferedFrames() {
+	auto start = std::chrono::steady_clock::now();
+	size_t occupancy = buffer.size();
+	if (occupancy > peakOccupancy)
+		peakOccupancy = occupancy;
+
+	// Wake up more often while the ring buffer fills up faster than expected, for example after a
+	// slow write, and go back to larger batches per write once the writer keeps up again.
+	unsigned int interval = wakeupInterval;
+	if (occupancy > buffer.capacity / 2 && interval > BLOCKSIZE)
+		wakeupInterval = interval / 2;
+	else if (occupancy < buffer.capacity / 8 && interval < buffer.capacity / 8)
+		wakeupInterval = interval * 2;
+
+	Frame<ChannelCount> *frames;
+	size_t numFrames;
+	while ((numFrames = buffer.peek(&frames)) > 0) {
+		for (size_t done = 0; done < numFrames; done += WRITESIZE) {
+			if (!writeFrames(frames + done, std::min(numFrames - done, (size_t) WRITESIZE), packedLayout))
+				return false;
+		}
+		buffer.consume(numFrames);
+	}
+	writeDropoutMarkers();
+
+	// The flush of a deferred take after it stopped, or its first drain after a fallback, is not a stall.
+	std::chrono::duration<float> stall = std::chrono::steady_clock::now() - start;
+	if (stall.count() > longestStall && !deferredTake)
+		longestStall = stall.count();
+	return true;
+}
+
+// Mark the dropouts step() reported in every open file. A dropout still in progress when
+// the recording stops is only counted, as the writer cannot know its final length.
+// FLAC files have no markers, so their dropouts are only counted.
+template <unsigned int ChannelCount>
+void Recorder<ChannelCount>::writeDropoutMarkers() {
+	RecorderDropout *dropout;
+	while (dropouts.peek(&dropout) > 0) {
+		char label[WAV_CUE_LABEL_SIZE];
+		snprintf(label, sizeof(label), "Dropout, %u frames lost", dropout->numFrames);
+		for (unsigned int w = 0; w < numWriters && !flacTake; w++) {
+			Audio_WAV_AddCue(&writers[w], (unsigned long long) (dropout->frame * (double) fileRate / sampleRate), label);
+		}
+		dropouts.consume(1);
+	}
+}
+
+// Write the pre-roll step() froze when the take started, oldest frame first. This runs at disk
+// speed, usually many times faster than real time; the ring buffer holds the live frames meanwhile.
+template <unsigned int ChannelCount>
+bool Recorder<ChannelCount>::writeHistory() {
+	size_t size = history.size();
+	size_t done = 0;
+	while (done < historyFrames) {
+		size_t i = (historyPos + size - historyFrames + done) % size;
+		size_t n = std::min(std::min(historyFrames - done, size - i), (size_t) WRITESIZE);
+		if (!writeFrames(&history[i], n, channelMap))
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+// Write up to WRITESIZE frames to every open file, at the file sample rate.
+// Channel c of the file, or stem c, is at frame sample layout[c].
+template <unsigned int ChannelCount>
+bool Recorder<ChannelCount>::writeFrames(Frame<ChannelCount> *frames, size_t numFrames, const unsigned int *layout) {
+	const float *src = frames[0].samples;
+	if (numChannels < ChannelCount) {
+		// Leave out the unrecorded inputs.
+		for (size_t f = 0; f < numFrames; f++)
+			for (unsigned int c = 0; c < numChannels; c++)
+				gatherBuffer[f*numChannels + c] = frames[f].samples[layout[c]];
+		src = gatherBuffer;
+	}
+	if (!resampling)
+		return writePacked(src, numFrames);
+	for (size_t done = 0; done < numFrames; done += resampler.maxInput) {
+		size_t n = resampler.process(src + done*numChannels, std::min(numFrames - done, resampler.maxInput), resampleBuffer);
+		if (n > 0 && !writePacked(resampleBuffer, n))
+			return false;
+	}
+	return true;
+}
+
+// Convert up to WRITESIZE frames of numChannels interleaved samples to the file's sample format
+// and write them to every open file.
+template <unsigned int ChannelCount>
+bool Recorder<ChannelCount>::writePacked(const float *frames, size_t numFrames) {
+	for (unsigned int w = 0; w < numWriters; w++) {
+		const float *src = frames;
+		int channels = numChannels;
+		if (numWriters > 1) {
+			// Stem: pick the writer's channel out of each frame.
+			for (size_t f = 0; f < numFrames; f++)
+				stemBuffer[f] = frames[f*numChannels + w];
+			src = stemBuffer;
+			channels = 1;
+		}
+
+		// Mapped WAV files are converted straight into the file, the others through
+		// writeBuffer. FLAC takes are encoded here as well, a block of FLAC_BLOCKSIZE frames at a time.
+		bool mapped = !flacTake && writers[w].isMapped;
+		unsigned char *dest = writeBuffer;
+		if (mapped)
+			dest = Audio_WAV_BeginWrite(&writers[w], numFrames * channels * pcmBytesPerSample(takeSampleFormat));
+		long result = -1;
+		if (dest) {
+			size_t numBytes = pcmConvert(takeSampleFormat, src, dest, numFrames, channels, &dither[w]);
+			if (flacTake)
+				result = flacWriters[w].writeBytes(dest, numBytes);
+			else if (mapped)
+				result = Audio_WAV_EndWrite(&writers[w], numBytes);
+			else
+				result = Audio_WAV_WriteBytes(&writers[w], dest, numBytes);
+		}
+		if (result < 0) {
+			char msg[100];
+			snprintf(msg, sizeof(msg), "Failed to write the recording file, result = %ld\n", result);
+			osdialog_message(OSDIALOG_ERROR, OSDIALOG_OK, msg);
+			fprintf(stderr, "%s", msg);
+			return false;
+		}
+
+		if (overviews[w].file && overviews[w].write(src, numFrames) < 0) {
+			fprintf(stderr, "Failed to write the overview file, recording without it\n");
+			overviews[w].close();
+		}
+	}
+	updateLevels();
+	return true;
+}
+
+// Meter brightness from the peaks of the overviews, over a range of 48 dB.
+template <unsigned int ChannelCount>
+void Recorder<ChannelCount>::updateLevels() {
+	for (unsigned int w = 0; w < numWriters; w++) {
+		if (!overviews[w].file)
+			continue;
+		int channels = (numWriters > 1) ? 1 : numChannels;
+		for (int c = 0; c < channels; c++) {
+			float peak = overviews[w].peaks[c];
+			float brightness = (peak > 0.f) ? clamp(1.f + 20.f * log10f(peak) / 48.f, 0.f, 1.f) : 0.f;
+			levels[channelMap[w + c]].store(brightness, std::memory_order_relaxed);
+		}
+	}
+}
+
+template <unsigned int ChannelCount>
+void Recorder<ChannelCount>::step() {
+	unsigned long long now = recorderClock.tick(this);
+
+	// Rising gates start a take, falling gates stop it, with the thresholds of SchmittTrigger.
+	// The gate of a synchronized recorder starts and stops all of them, one frame later.
+	if (inputs[GATE_INPUT].active) {
+		float gate = inputs[GATE_INPUT].value;
+		if (!gateHigh && gate >= 1.0) {
+			gateHigh = true;
+			if (sync)
+				recorderClock.requestStart();
+			else
+				startRequested = true;
+		}
+		else if (gateHigh && gate <= 0.0) {
+			gateHigh = false;
+			if (sync)
+				recorderClock.requestStop();
+			else
+				stopRequested = true;
+		}
+	}
+	if (sync && now == recorderClock.startFrame && state != RECORDER_RECORDING)
+		startRequested = true;
+	if (sync && now == recorderClock.stopFrame)
+		stopRequested = true;
+
+	// A stop also cancels a start that is still waiting for the writer thread.
+	if (stopRequested.load(std::memory_order_relaxed)) {
+		stopRequested = false;
+		startRequested = false;
+		if (state == RECORDER_RECORDING) {
+			state = RECORDER_FINISHING;
+			recorderService.wakeup();
+		}
+	}
+	// A take starts on this very frame if the writer thread is ready; otherwise the request
+	// waits until it has finished the previous take.
+	if (startRequested.load(std::memory_order_relaxed) && state == RECORDER_READY) {
+		startRequested = false;
+		if (selectChannels()) {
+			// Dropouts are marked at their position in the file, which starts with the pre-roll.
+			capturedFrames = historyFrames;
+			takeStartFrame = now - historyFrames;
+			takeStartTime = (long long) time(NULL) - (long long) (historyFrames / engineGetSampleRate());
+			dropoutFrames = 0;
+			droppedFrames = 0;
+			numDropouts = 0;
+			framesSinceWakeup = 0;
+			state = RECORDER_RECORDING;
+			recorderService.wakeup();
+		}
+	}
+	else if (prepareRequested.load(std::memory_order_relaxed) && state == RECORDER_READY) {
+		prepareRequested = false;
+		state = RECORDER_PREPARING;
+		recorderService.wakeup();
+	}
+
+	int s = state;
+	lights[RECORDING_LIGHT].value = (s == RECORDER_RECORDING) ? 1.0 : 0.0;
+	lights[DROPOUT_LIGHT].value = (numDropouts.load(std::memory_order_relaxed) > 0) ? 1.0 : 0.0;
+	for (unsigned int i = 0; i < ChannelCount; i++) {
+		lights[LEVEL1_LIGHT + i].value = levels[i].load(std::memory_order_relaxed);
+	}
+	if (s == RECORDER_READY && !history.empty()) {
+		// Keep the pre-roll of every input, as the channels of the next take are not known yet.
+		Frame<ChannelCount> &f = history[historyPos];
+		for (unsigned int i = 0; i < ChannelCount; i++) {
+			f.samples[i] = inputs[AUDIO1_INPUT + i].value / 5.0;
+		}
+		if (++historyPos == history.size())
+			historyPos = 0;
+		if (historyFrames < history.size())
+			historyFrames++;
+	}
+	else if (s == RECORDER_RECORDING) {
+		// Read input samples into recording buffer. Frames are dropped when the buffer is full.
+		Frame<ChannelCount> f;
+		for (unsigned int i = 0; i < numChannels; i++) {
+			f.samples[i] = inputs[AUDIO1_INPUT + channelMap[i]].value / 5.0;
+		}
+		if (buffer.push(f)) {
+			if (dropoutFrames > 0) {
+				// The dropout is over; let the writer mark it. Markers are lost if it falls far behind.
+				dropouts.push(RecorderDropout{capturedFrames, dropoutFrames});
+				dropoutFrames = 0;
+			}
+			capturedFrames++;
+		}
+		else {
+			if (dropoutFrames++ == 0)
+				numDropouts.fetch_add(1, std::memory_order_relaxed);
+			droppedFrames.fetch_add(1, std::memory_order_relaxed);
+		}
+		if (++framesSinceWakeup >= wakeupInterval.load(std::memory_order_relaxed)) {
+			framesSinceWakeup = 0;
+			recorderService.wakeup();
+		}
+	}
+}
+
+struct RecordButton : LEDButton {
+	using Callback = std::function<void()>;
+
+	Callback onPressCallback;
+	SchmittTrigger recordTrigger;
+
+	void onChange(EventChange &e) override {
+		if (recordTrigger.process(value)) {
+			onPress(e);
+		}
+	}
+	void onPress(EventChange &e) {
+		assert (onPressCallback);
+		onPressCallback();
+	}
+};
+
+/** Context menu entry that sets one of the recorder's int options, with a checkmark when selected. */
+struct RecorderOptionItem : MenuItem {
+	int *option;
+	int value;
+	void onAction(EventAction &e) override {
+		*option = value;
+	}
+	void step() override {
+		rightText = CHECKMARK(*option == value);
+		MenuItem::step();
+	}
+};
+
+/** Sets or clears the directory that takes are written to without a save dialog. */
+template <unsigned int ChannelCount>
+struct RecorderDirectoryItem : MenuItem {
+	Recorder<ChannelCount> *recorder;
+	bool choose;
+	void onAction(EventAction &e) override {
+		std::string directory;
+		if (choose) {
+			char *path = osdialog_file(OSDIALOG_OPEN_DIR, NULL, NULL, NULL);
+			if (!path)
+				return;
+			directory = path;
+			free(path);
+		}
+		std::lock_guard<std::mutex> lock(recorder->filenameMutex);
+		recorder->outputDirectory = directory;
+	}
+};
+
+/** Fixes the header of a WAV file left behind by a crash, for files from before header refresh
+or the last second of a take. */
+struct RecorderRepairItem : MenuItem {
+	void onAction(EventAction &e) override {
+		char *path = osdialog_file(OSDIALOG_OPEN, NULL, NULL, NULL);
+		if (!path)
+			return;
+		unsigned long long dataSize = 0;
+		long result = Audio_WAV_RepairFile(path, &dataSize);
+		free(path);
+		std::string msg;
+		if (result < 0)
+			msg = stringf("Could not repair the file, result = %ld", result);
+		else if (result == 0)
+			msg = "The file is intact, nothing was changed.";
+		else
+			msg = stringf("Repaired the file, it now holds %.1f MB of audio.", dataSize / (1024. * 1024.));
+		osdialog_message(result < 0 ? OSDIALOG_ERROR : OSDIALOG_INFO, OSDIALOG_OK, msg.c_str());
+	}
+};
+
+template <unsigned int ChannelCount>
+struct RecorderTemplateItem : MenuItem {
+	Recorder<ChannelCount> *recorder;
+	std::string filenameTemplate;
+	void onAction(EventAction &e) override {
+		std::lock_guard<std::mutex> lock(recorder->filenameMutex);
+		recorder->filenameTemplate = filenameTemplate;
+	}
+};
+
+template <unsigned int ChannelCount>
+struct RecorderWidget : ModuleWidget {
+	RecorderWidget(Recorder<ChannelCount> *module);
+	void step() override;
+	void appendContextMenu(Menu *menu) override;
+	void appendOptions(Menu *menu, const char *title, int *option, const char **names, const int *values, int count);
+};
+
+template <unsigned int ChannelCount>
+RecorderWidget<ChannelCount>::RecorderWidget(Recorder<ChannelCount> *module) : ModuleWidget(module) {
+	// Inputs are laid out in rows of two, four or eight, so that no panel needs more than four rows.
+	unsigned int columns = std::max(2u, ChannelCount / 4);
+	float margin = 5;
+	float labelHeight = 15;
+	float yPos = margin;
+	float xPos = margin;
+	box.size = Vec(std::max(15*6+5.f, 10 + columns * (37 + margin)), 380);
+
+	Panel *panel = new LightPanel();
+	panel->box.size = box.size;
+	addChild(panel);
+
+	addChild(Widget::create<ScrewSilver>(Vec(15, 0)));
+	addChild(Widget::create<ScrewSilver>(Vec(box.size.x-30, 0)));
+	addChild(Widget::create<ScrewSilver>(Vec(15, 365)));
+	addChild(Widget::create<ScrewSilver>(Vec(box.size.x-30, 365)));
+
+	Label *recorderLabel = new Label();
+	recorderLabel->box.pos = Vec(xPos, yPos + 5); // shim to put label below screws
+	recorderLabel->text = "Recorder " + std::to_string(ChannelCount);
+	addChild(recorderLabel);
+	yPos += labelHeight + margin;
+
+	xPos = box.size.x / 2 - 12.5;
+	yPos += 2*margin;
+	ParamWidget *recordButton = ParamWidget::create<RecordButton>(Vec(xPos, yPos-1), module, Recorder<ChannelCount>::RECORD_PARAM, 0.0, 1.0, 0.0);
+	RecordButton *btn = dynamic_cast<RecordButton*>(recordButton);
+	Recorder<ChannelCount> *recorder = module;
+
+	btn->onPressCallback = [=]()
+	{
+		if (!recorder->isRecording()) {
+			recorder->startRecording();
+		} else {
+			recorder->stopRecording();
+		}
+	};
+	addParam(recordButton);
+	addChild(ModuleLightWidget::create<SmallLight<RedLight>>(Vec(xPos+6, yPos+5), module, Recorder<ChannelCount>::RECORDING_LIGHT));
+	// Lights up when the current or last recording lost frames; see the context menu for details.
+	addChild(ModuleLightWidget::create<SmallLight<YellowLight>>(Vec(xPos+30, yPos+5), module, Recorder<ChannelCount>::DROPOUT_LIGHT));
+	xPos = margin;
+	yPos += recordButton->box.size.y + 3*margin;
+
+	xPos = 10;
+	addInput(Port::create<PJ3410Port>(Vec(xPos, yPos), Port::INPUT, module, Recorder<ChannelCount>::GATE_INPUT));
+	Label *gateLabel = new Label();
+	gateLabel->box.pos = Vec(xPos + 37, yPos + 8);
+	gateLabel->text = "Gate";
+	addChild(gateLabel);
+	xPos = margin;
+	yPos += 40 + margin;
+
+	Label *channelLabel = new Label();
+	channelLabel->box.pos = Vec(margin, yPos);
+	channelLabel->text = "Channels";
+	addChild(channelLabel);
+	yPos += labelHeight + margin;
+
+	yPos += 5;
+	xPos = 10;
+	for (unsigned int i = 0; i < ChannelCount; i++) {
+		addInput(Port::create<PJ3410Port>(Vec(xPos, yPos), Port::INPUT, module, i));
+		Label *portLabel = new Label();
+		portLabel->box.pos = Vec(xPos + 4, yPos + 28);
+		portLabel->text = stringf("%d", i + 1);
+		addChild(portLabel);
+		// Peak level of the input in the take, while recording.
+		addChild(ModuleLightWidget::create<TinyLight<GreenLight>>(Vec(xPos + 24, yPos + 33), module, Recorder<ChannelCount>::LEVEL1_LIGHT + i));
+
+		if (i % columns != columns - 1) {
+			xPos += 37 + margin;
+		} else {
+			xPos = 10;
+			yPos += 40 + margin;
+		}
+	}
+}
+
+// Keeps the recorder's copy of the patch path current, for the {patch} file name token.
+template <unsigned int ChannelCount>
+void RecorderWidget<ChannelCount>::step() {
+	Recorder<ChannelCount> *recorder = dynamic_cast<Recorder<ChannelCount>*>(module);
+	if (recorder && gRackWidget && recorder->patchPath != gRackWidget->lastPath) {
+		std::lock_guard<std::mutex> lock(recorder->filenameMutex);
+		recorder->patchPath = gRackWidget->lastPath;
+	}
+	ModuleWidget::step();
+}
+
+template <unsigned int ChannelCount>
+void RecorderWidget<ChannelCount>::appendOptions(Menu *menu, const char *title, int *option, const char **names, const int *values, int count) {
+	menu->addChild(new MenuEntry());
+	MenuLabel *label = new MenuLabel();
+	label->text = title;
+	menu->addChild(label);
+
+	for (int i = 0; i < count; i++) {
+		RecorderOptionItem *item = new RecorderOptionItem();
+		item->text = names[i];
+		item->option = option;
+		item->value = values[i];
+		menu->addChild(item);
+	}
+}
+
+template <unsigned int ChannelCount>
+void RecorderWidget<ChannelCount>::appendContextMenu(Menu *menu) {
+	Recorder<ChannelCount> *recorder = dynamic_cast<Recorder<ChannelCount>*>(module);
+	assert(recorder);
+
+	const char *fileTypeNames[] = {"WAV", "FLAC (lossless, up to 8 channels per file)"};
+	const int fileTypes[] = {RECORDER_FILE_WAV, RECORDER_FILE_FLAC};
+	appendOptions(menu, "File type (applies to the next recording)", &recorder->fileType, fileTypeNames, fileTypes, 2);
+
+	const char *formatNames[] = {"16-bit PCM", "24-bit PCM", "32-bit float (24-bit for FLAC)"};
+	const int formats[] = {WAV_SAMPLE_INT16, WAV_SAMPLE_INT24, WAV_SAMPLE_FLOAT32};
+	appendOptions(menu, "Sample format (applies to the next recording)", &recorder->sampleFormat, formatNames, formats, 3);
+
+	const char *outputRateNames[] = {"Engine sample rate", "44.1 kHz", "48 kHz", "88.2 kHz", "96 kHz"};
+	const int outputRates[] = {0, 44100, 48000, 88200, 96000};
+	appendOptions(menu, "File sample rate (applies to the next recording)", &recorder->outputRate, outputRateNames, outputRates, 5);
+
+	const char *ditherNames[] = {"Off", "TPDF", "TPDF, noise shaped"};
+	const int ditherModes[] = {PCM_DITHER_NONE, PCM_DITHER_TPDF, PCM_DITHER_SHAPED};
+	appendOptions(menu, "Dither (16-bit and 24-bit PCM)", &recorder->ditherMode, ditherNames, ditherModes, 3);
+
+	const char *channelNames[] = {"All inputs, one file", "Connected inputs, one file", "Connected inputs, one file each"};
+	const int channelModes[] = {RECORD_ALL_INPUTS, RECORD_CONNECTED_INPUTS, RECORD_CONNECTED_STEMS};
+	appendOptions(menu, "Channels (applies to the next recording)", &recorder->channelMode, channelNames, channelModes, 3);
+
+	const char *latencyNames[] = {"0.5 s", "1 s", "2 s", "5 s"};
+	const int latencies[] = {500, 1000, 2000, 5000};
+	appendOptions(menu, "Buffer length (grows after dropouts)", &recorder->bufferLatency, latencyNames, latencies, 4);
+
+	const char *writeModeNames[] = {"Buffered", "Memory mapped (Linux, WAV only)"};
+	const int writeModes[] = {RECORDER_WRITE_BUFFERED, RECORDER_WRITE_MAPPED};
+	appendOptions(menu, "Disk writes (applies to the next recording)", &recorder->writeMode, writeModeNames, writeModes, 2);
+
+	const char *syncNames[] = {"Off", "On"};
+	const int syncModes[] = {0, 1};
+	appendOptions(menu, "Start and stop with the other synchronized recorders", &recorder->sync, syncNames, syncModes, 2);
+
+	const char *ramCaptureNames[] = {"Off, stream to disk", "256 MB", "1 GB", "4 GB"};
+	const int ramCaptures[] = {0, 256, 1024, 4096};
+	appendOptions(menu, "Capture to RAM, write after the take", &recorder->ramCapture, ramCaptureNames, ramCaptures, 4);
+
+	const char *preRollNames[] = {"Off", "5 s", "10 s", "30 s"};
+	const int preRolls[] = {0, 5, 10, 30};
+	appendOptions(menu, "Pre-roll (audio from before the take starts)", &recorder->preRoll, preRollNames, preRolls, 4);
+
+	menu->addChild(new MenuEntry());
+	MenuLabel *directoryLabel = new MenuLabel();
+	directoryLabel->text = "Output directory";
+	menu->addChild(directoryLabel);
+
+	std::string directory, filenameTemplate;
+	{
+		std::lock_guard<std::mutex> lock(recorder->filenameMutex);
+		directory = recorder->outputDirectory;
+		filenameTemplate = recorder->filenameTemplate;
+	}
+	RecorderDirectoryItem<ChannelCount> *askItem = new RecorderDirectoryItem<ChannelCount>();
+	askItem->text = "None, ask for a file name";
+	askItem->rightText = CHECKMARK(directory.empty());
+	askItem->recorder = recorder;
+	askItem->choose = false;
+	menu->addChild(askItem);
+	RecorderDirectoryItem<ChannelCount> *chooseItem = new RecorderDirectoryItem<ChannelCount>();
+	chooseItem->text = directory.empty() ? "Choose..." : directory;
+	chooseItem->rightText = CHECKMARK(!directory.empty());
+	chooseItem->recorder = recorder;
+	chooseItem->choose = true;
+	menu->addChild(chooseItem);
+
+	menu->addChild(new MenuEntry());
+	MenuLabel *templateLabel = new MenuLabel();
+	templateLabel->text = stringf("File names (next take is %d)", recorder->takeNumber.load());
+	menu->addChild(templateLabel);
+
+	const char *templates[] = {"{patch}_{timestamp}", "{patch}_take{take}", "{timestamp}", "take{take}"};
+	for (const char *t : templates) {
+		RecorderTemplateItem<ChannelCount> *item = new RecorderTemplateItem<ChannelCount>();
+		item->text = std::string(t) + (recorder->fileType == RECORDER_FILE_FLAC ? ".flac" : ".wav");
+		item->rightText = CHECKMARK(filenameTemplate == t);
+		item->recorder = recorder;
+		item->filenameTemplate = t;
+		menu->addChild(item);
+	}
+
+	menu->addChild(new MenuEntry());
+	MenuLabel *statsLabel = new MenuLabel();
+	statsLabel->text = recorder->isRecording() ? "Current recording" : "Last recording";
+	menu->addChild(statsLabel);
+
+	const std::string stats[] = {
+		stringf("Dropped frames: %llu in %u dropouts", recorder->droppedFrames.load(), recorder->numDropouts.load()),
+		stringf("Longest write: %.1f ms", 1000.f * recorder->longestStall),
+		stringf("Peak buffer use: %d%% of %d frames", (int) (100 * recorder->peakOccupancy / recorder->bufferCapacity), (int) recorder->bufferCapacity.load()),
+		stringf("Time reference: engine frame %llu", recorder->takeStartFrame.load()),
+	};
+	for (const std::string &text : stats) {
+		MenuLabel *label = new MenuLabel();
+		label->text = text;
+		menu->addChild(label);
+	}
+	if (recorder->ramCapture > 0) {
+		MenuLabel *label = new MenuLabel();
+		label->text = stringf("RAM arena use: %d%% of %d MB", (int) (100 * recorder->peakOccupancy / recorder->bufferCapacity), recorder->ramCapture);
+		menu->addChild(label);
+	}
+
+	menu->addChild(new MenuEntry());
+	RecorderRepairItem *repairItem = new RecorderRepairItem();
+	repairItem->text = "Repair a WAV file after a crash...";
+	menu->addChild(repairItem);
+}
+
+Model *modelRecorder2 = Model::create<Recorder<2>, RecorderWidget<2>>("dekstop", "Recorder2", "Recorder 2", UTILITY_TAG);
+Model *modelRecorder8 = Model::create<Recorder<8>, RecorderWidget<8>>("dekstop", "Recorder8", "Recorder 8", UTILITY_TAG);
+Model *modelRecorder16 = Model::create<Recorder<16>, RecorderWidget<16>>("dekstop", "Recorder16", "Recorder 16", UTILITY_TAG);
+Model *modelRecorder32 = Model::create<Recorder<32>, RecorderWidget<32>>("dekstop", "Recorder32", "Recorder 32", UTILITY_TAG);
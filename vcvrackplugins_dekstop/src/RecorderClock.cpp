@@ -0,0 +1,37 @@
+#include <algorithm>
+
+#include "RecorderClock.hpp"
+
+
+RecorderClock recorderClock;
+
+void RecorderClock::add(rack::Module *module) {
+	std::lock_guard<std::mutex> lock(mutex);
+	members.push_back(module);
+	changed = true;
+}
+
+void RecorderClock::remove(rack::Module *module) {
+	std::lock_guard<std::mutex> lock(mutex);
+	members.erase(std::remove(members.begin(), members.end(), module), members.end());
+	changed = true;
+}
+
+// Audio thread. Modules are constructed before the engine adds them to gModules, so the leader is
+// chosen again until every member has been found there. If the UI thread holds the lock, the next
+// tick tries again.
+void RecorderClock::chooseLeader() {
+	std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+	if (!lock.owns_lock())
+		return;
+	leader = NULL;
+	size_t found = 0;
+	for (rack::Module *module : rack::gModules) {
+		if (std::find(members.begin(), members.end(), module) != members.end()) {
+			if (!leader)
+				leader = module;
+			found++;
+		}
+	}
+	changed = (found < members.size());
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "rack.hpp"
+
+/** Engine frame counter shared by all recorder modules, so that takes started in the same engine
+frame get the same timestamp, and a start or stop request reaches every synchronized recorder in
+the same frame.
+
+Rack steps the modules one after another in the order of gModules. The first recorder in that
+order advances the clock, so every recorder reads the same frame number within an engine frame.
+It is chosen again on the audio thread after recorders are added or removed.
+*/
+struct RecorderClock {
+	std::mutex mutex; // guards members
+	std::vector<rack::Module*> members;
+	std::atomic_bool changed; // members changed since the leader was chosen
+	std::atomic_bool startPending;
+	std::atomic_bool stopPending;
+
+	// Audio thread only
+	rack::Module *leader = NULL;
+	unsigned long long frame = 0;
+	unsigned long long startFrame = ~0ULL; // of the last synchronized start
+	unsigned long long stopFrame = ~0ULL;
+
+	RecorderClock() : changed(false), startPending(false), stopPending(false) {}
+	void add(rack::Module *module);
+	void remove(rack::Module *module);
+	/** Called at the start of every member's step(). Returns the current engine frame. */
+	unsigned long long tick(rack::Module *module) {
+		if (changed.load(std::memory_order_relaxed) || !leader)
+			chooseLeader();
+		if (module == leader) {
+			frame++;
+			if (startPending.load(std::memory_order_relaxed) && startPending.exchange(false))
+				startFrame = frame;
+			if (stopPending.load(std::memory_order_relaxed) && stopPending.exchange(false))
+				stopFrame = frame;
+		}
+		return frame;
+	}
+	/** Starts the synchronized recorders in the next engine frame. Safe to call from any thread. */
+	void requestStart() {
+		startPending = true;
+	}
+	void requestStop() {
+		stopPending = true;
+	}
+	void chooseLeader();
+};
+
+extern RecorderClock recorderClock;
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <utility>
+
+#include "RecorderService.hpp"
+
+#define MAXWORKERS 4
+#define MAXWAIT 0.5f // seconds, when no stream asks for less
+
+
+RecorderService recorderService;
+
+RecorderService::~RecorderService() {
+	std::unique_lock<std::mutex> lock(mutex);
+	stopWorkers(lock);
+}
+
+void RecorderService::add(RecorderStream *stream) {
+	std::lock_guard<std::mutex> lock(mutex);
+	streams.push_back(stream);
+	if (workers.empty()) {
+		// One worker per two cores, as most of the time goes to waiting for the disk.
+		unsigned int numWorkers = std::max(1u, std::min((unsigned int) MAXWORKERS, std::thread::hardware_concurrency() / 2));
+		for (unsigned int i = 0; i < numWorkers; i++) {
+			workers.push_back(std::thread(&RecorderService::run, this, generation.load()));
+		}
+	}
+	semaphore.post();
+}
+
+void RecorderService::remove(RecorderStream *stream) {
+	std::unique_lock<std::mutex> lock(mutex);
+	streams.erase(std::remove(streams.begin(), streams.end(), stream), streams.end());
+	released.wait(lock, [stream]() { return !stream->busy; });
+	if (streams.empty()) {
+		stopWorkers(lock);
+	}
+}
+
+// Joins the workers outside the lock, which they need to finish their pass. A stream added
+// meanwhile starts workers of the next generation.
+void RecorderService::stopWorkers(std::unique_lock<std::mutex> &lock) {
+	std::vector<std::thread> stopped;
+	stopped.swap(workers);
+	generation++;
+	lock.unlock();
+	for (size_t i = 0; i < stopped.size(); i++) {
+		semaphore.post();
+	}
+	for (std::thread &worker : stopped) {
+		worker.join();
+	}
+	lock.lock();
+}
+
+void RecorderService::run(unsigned int workerGeneration) {
+	std::vector<std::pair<float, RecorderStream*>> queue;
+	while (generation == workerGeneration) {
+		// Take the fullest ring buffers first, while the other workers take whatever is left.
+		queue.clear();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (RecorderStream *stream : streams) {
+				queue.push_back(std::make_pair(stream->urgency(), stream));
+			}
+		}
+		std::sort(queue.begin(), queue.end(), [](const std::pair<float, RecorderStream*> &a, const std::pair<float, RecorderStream*> &b) {
+			return a.first > b.first;
+		});
+
+		float wait = MAXWAIT;
+		bool helped = false;
+		for (auto &entry : queue) {
+			RecorderStream *stream = entry.second;
+			std::unique_lock<std::mutex> lock(mutex);
+			// The stream may have been removed since the queue was made, and must not be touched then.
+			if (std::find(streams.begin(), streams.end(), stream) == streams.end() || stream->busy)
+				continue;
+			stream->busy = true;
+			lock.unlock();
+
+			// Wake another worker for the rest of the queue while this one writes.
+			if (!helped && entry.first > 0.f && &entry != &queue.back()) {
+				helped = true;
+				semaphore.post();
+			}
+			wait = std::min(wait, stream->service());
+
+			lock.lock();
+			stream->busy = false;
+			released.notify_all();
+		}
+
+		if (wait > 0.f && generation == workerGeneration) {
+			semaphore.wait(wait);
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Semaphore.hpp"
+
+/** The disk side of one recorder module, serviced by the RecorderService workers.
+A stream is only ever serviced by one worker at a time.
+*/
+struct RecorderStream {
+	std::atomic_bool busy; // claimed by a worker
+
+	RecorderStream() : busy(false) {}
+	virtual ~RecorderStream() {}
+	/** Does the writing, opening and closing that is due, and returns the longest time in
+	seconds until it should be called again. A stream calls RecorderService::wakeup() when it
+	needs service sooner.
+	*/
+	virtual float service() = 0;
+	/** How much the stream needs service, from 0 for idle to 1 for a full ring buffer. */
+	virtual float urgency() = 0;
+};
+
+/** Process-wide writer threads shared by all recorder modules.
+
+A small fixed pool of workers services every registered stream, the fullest ring buffers first,
+so that a patch with dozens of recorders does not have as many threads competing for the disk.
+The workers are started with the first stream and stopped after the last one is removed.
+*/
+struct RecorderService {
+	std::mutex mutex;
+	std::condition_variable released; // notified when a worker is done with a stream
+	std::vector<RecorderStream*> streams;
+	std::vector<std::thread> workers;
+	std::atomic<unsigned int> generation; // of the running workers, which quit when it changes
+	Semaphore semaphore;
+
+	RecorderService() : generation(0) {}
+	~RecorderService();
+	/** Starts servicing `stream`, immediately. */
+	void add(RecorderStream *stream);
+	/** Stops servicing `stream`, and waits for a worker that is still busy with it. */
+	void remove(RecorderStream *stream);
+	/** Safe to call from the audio thread. */
+	void wakeup() {
+		semaphore.post();
+	}
+	void stopWorkers(std::unique_lock<std::mutex> &lock);
+	void run(unsigned int workerGeneration);
+};
+
+extern RecorderService recorderService;
@@ -0,0 +1,219 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "Resampler.hpp"
+#include "write_wav.h"
+
+#define RESAMPLER_MAX_PHASES 1024 // 44.1 kHz <-> 48 kHz needs 160
+#define RESAMPLER_CUTOFF 0.46 // of the lower rate, halfway between the pass and stop band edges
+
+
+static double besselI0(double x) {
+	double sum = 1.0, term = 1.0;
+	for (int k = 1; k < 50; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+static int gcd(int a, int b) {
+	while (b != 0) {
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+long Resampler::init(int inputRate, int outputRate, int samplesPerFrame, size_t maxInputFrames) {
+	if (inputRate < 1 || outputRate < 1 || samplesPerFrame < 1 || samplesPerFrame > RESAMPLER_MAX_CHANNELS || maxInputFrames < 1)
+		return WAV_ERR_ILLEGAL_VALUE;
+	int g = gcd(inputRate, outputRate);
+	if (outputRate / g > RESAMPLER_MAX_PHASES)
+		return WAV_ERR_ILLEGAL_VALUE;
+
+	inRate = inputRate;
+	outRate = outputRate;
+	up = outputRate / g;
+	down = inputRate / g;
+	numChannels = samplesPerFrame;
+	stride = (numChannels + 3) & ~3;
+	maxInput = maxInputFrames;
+	// The filter spans RESAMPLER_TAPS samples at the lower rate, which is more input samples when decimating.
+	taps = (int) (((long long) RESAMPLER_TAPS * std::max(up, down) + up - 1) / up);
+
+	// Prototype at up * inRate, centered on `delay`, with unity gain in every phase
+	int length = taps * up;
+	delay = (length - 1) / 2;
+	double cutoff = RESAMPLER_CUTOFF * std::min(inputRate, outputRate) / inputRate; // cycles per input sample
+	std::vector<double> prototype(length);
+	for (int j = 0; j < length; j++) {
+		double x = (double) (j - delay) / up; // in input samples
+		double sinc = (x == 0.0) ? 1.0 : sin(2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x);
+		double w = (double) (j - delay) / (length / 2.0);
+		double window = (fabs(w) < 1.0) ? besselI0(RESAMPLER_KAISER_BETA * sqrt(1.0 - w * w)) / besselI0(RESAMPLER_KAISER_BETA) : 0.0;
+		prototype[j] = 2 * cutoff * sinc * window;
+	}
+	// Phase p weighs input frame i - k with prototype[p + k * up]; stored oldest frame first.
+	coefs.assign(up * taps, 0.f);
+	for (int p = 0; p < up; p++) {
+		double sum = 0.0;
+		for (int k = 0; k < taps; k++)
+			sum += prototype[p + k * up];
+		for (int k = 0; k < taps; k++)
+			coefs[p * taps + (taps - 1 - k)] = (float) (prototype[p + k * up] / sum);
+	}
+
+	// The history before the first frame is silence.
+	buffer.assign((taps - 1 + maxInput) * stride, 0.f);
+	bufferStart = -(taps - 1);
+	bufferFrames = taps - 1;
+	nextInput = delay / up;
+	nextPhase = delay % up;
+	inputFrames = 0;
+	outputFrames = 0;
+	return 0;
+}
+
+size_t Resampler::process(const float *in, size_t numFrames, float *out) {
+	numFrames = std::min(numFrames, maxInput);
+	float *dest = &buffer[bufferFrames * stride];
+	for (size_t f = 0; f < numFrames; f++, dest += stride, in += numChannels)
+		memcpy(dest, in, numChannels * sizeof(float));
+	bufferFrames += numFrames;
+	inputFrames += numFrames;
+
+	size_t produced = 0;
+	while (nextInput < bufferStart + (long long) bufferFrames) {
+		filter(&buffer[(nextInput - taps + 1 - bufferStart) * stride], &coefs[nextPhase * taps], out + produced * numChannels);
+		produced++;
+		nextPhase += down;
+		nextInput += nextPhase / up;
+		nextPhase %= up;
+	}
+	outputFrames += produced;
+
+	// Keep the frames the next output needs.
+	long long drop = std::min(nextInput - taps + 1 - bufferStart, (long long) bufferFrames);
+	if (drop > 0) {
+		memmove(&buffer[0], &buffer[drop * stride], (bufferFrames - drop) * stride * sizeof(float));
+		bufferStart += drop;
+		bufferFrames -= drop;
+	}
+	return produced;
+}
+
+size_t Resampler::flush(float *out) {
+	unsigned long long total = (inputFrames * up + down - 1) / down;
+	if (outputFrames >= total)
+		return 0;
+	// Push silence through the filter, without counting it as input.
+	static const float silence[RESAMPLER_MAX_CHANNELS] = {};
+	size_t produced = 0;
+	unsigned long long fed = inputFrames;
+	for (size_t f = 0; f < maxInput && produced == 0; f++)
+		produced = process(silence, 1, out);
+	inputFrames = fed;
+	if (outputFrames > total) {
+		produced -= outputFrames - total;
+		outputFrames = total;
+	}
+	return produced;
+}
+
+// One output frame from `taps` buffered frames, every channel at once.
+void Resampler::filter(const float *frames, const float *phaseCoefs, float *out) {
+	float sums[RESAMPLER_MAX_CHANNELS];
+#ifdef __SSE__
+	for (int c = 0; c < stride; c += 4) {
+		// Two sums, to hide the latency of the adds
+		__m128 sum0 = _mm_setzero_ps();
+		__m128 sum1 = _mm_setzero_ps();
+		const float *x = frames + c;
+		int k = 0;
+		for (; k + 1 < taps; k += 2, x += 2 * stride) {
+			sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_set1_ps(phaseCoefs[k]), _mm_loadu_ps(x)));
+			sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_set1_ps(phaseCoefs[k + 1]), _mm_loadu_ps(x + stride)));
+		}
+		if (k < taps)
+			sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_set1_ps(phaseCoefs[k]), _mm_loadu_ps(x)));
+		_mm_storeu_ps(sums + c, _mm_add_ps(sum0, sum1));
+	}
+#else
+	for (int c = 0; c < stride; c++)
+		sums[c] = 0.f;
+	for (int k = 0; k < taps; k++)
+		for (int c = 0; c < stride; c++)
+			sums[c] += phaseCoefs[k] * frames[k * stride + c];
+#endif
+	memcpy(out, sums, numChannels * sizeof(float));
+}
+
+
+/*********************************************************************************
+ * Benchmark: CPU time of the conversions from common engine rates to 48 kHz and
+ * 44.1 kHz, for each recorder channel count, in percent of one core in real time.
+ * Also prints the error on tones in the pass band and the aliasing of a tone just
+ * above it, in dB.
+ */
+#if 0
+#include <time.h>
+
+int main() {
+	const int rates[][2] = {{96000, 48000}, {192000, 48000}, {44100, 48000}, {96000, 44100}};
+	const int channelCounts[] = {2, 8, 16, 32};
+	const int seconds = 10, block = 4096;
+	static float in[block * RESAMPLER_MAX_CHANNELS], out[(block * 2 + 2) * RESAMPLER_MAX_CHANNELS];
+
+	for (const auto &rate : rates) {
+		for (int numChannels : channelCounts) {
+			Resampler resampler;
+			if (resampler.init(rate[0], rate[1], numChannels, block) < 0) return 1;
+			for (int i = 0; i < block * numChannels; i++)
+				in[i] = sinf(i * 0.001f);
+			clock_t start = clock();
+			for (int done = 0; done < seconds * rate[0]; done += block)
+				resampler.process(in, block, out);
+			double cpu = (double) (clock() - start) / CLOCKS_PER_SEC;
+			printf("%6d -> %5d Hz, %2d channels: %5.2f%% CPU, %d taps\n", rate[0], rate[1], numChannels, 100.0 * cpu / seconds, resampler.taps);
+		}
+
+		// Quality, on one channel: tones at 1 kHz and at 0.4 of the lower rate must come out clean,
+		// and when decimating, a tone at 0.55 of the output rate must vanish.
+		const double tones[] = {1000.0, 0.4 * std::min(rate[0], rate[1]), 0.55 * rate[1]};
+		for (double tone : tones) {
+			if (tone >= rate[0] / 2)
+				continue;
+			Resampler resampler;
+			resampler.init(rate[0], rate[1], 1, block);
+			double power = 0.0, error = 0.0;
+			long long n = 0, m = 0;
+			while (m < rate[1]) {
+				for (int i = 0; i < block; i++, n++)
+					in[i] = (float) sin(2 * M_PI * tone * n / rate[0]);
+				size_t produced = resampler.process(in, block, out);
+				for (size_t i = 0; i < produced; i++, m++) {
+					double ideal = (tone < rate[1] / 2) ? sin(2 * M_PI * tone * m / rate[1]) : 0.0;
+					if (m > rate[1] / 10) {
+						power += ideal * ideal;
+						error += (out[i] - ideal) * (out[i] - ideal);
+					}
+				}
+			}
+			if (tone < rate[1] / 2)
+				printf("%6d -> %5d Hz, %5.0f Hz tone: error %.1f dB\n", rate[0], rate[1], tone, 10 * log10(error / power));
+			else
+				printf("%6d -> %5d Hz, %5.0f Hz tone: aliasing %.1f dB\n", rate[0], rate[1], tone, 10 * log10(2 * error / (m - rate[1] / 10)));
+		}
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Polyphase sample rate converter for the recorder writer threads, for any ratio of integer rates.
+// The prototype is a Kaiser windowed sinc with RESAMPLER_TAPS taps at the lower of the two rates,
+// which passes 0.42 and stops 0.5 of the lower rate by about 90 dB, so nothing aliases into the band.
+// All channels of a frame are filtered together, 4 at a time with SSE.
+
+#define RESAMPLER_TAPS 64
+#define RESAMPLER_KAISER_BETA 8.6
+#define RESAMPLER_MAX_CHANNELS 32
+
+struct Resampler {
+	int inRate = 0;
+	int outRate = 0;
+	int up = 1; // L, output samples per `down` input samples after dividing by the gcd of the rates
+	int down = 1; // M
+	int numChannels = 0;
+	int stride = 0; // floats per buffered frame, numChannels rounded up to a multiple of 4
+	int taps = 0; // per phase
+	int delay = 0; // of the prototype filter, in samples at up * inRate
+	std::vector<float> coefs; // up phases of `taps` coefficients, oldest input frame first
+	size_t maxInput = 0; // frames per process() call
+
+	// Input frames from bufferStart on, padded to stride
+	std::vector<float> buffer;
+	long long bufferStart = 0;
+	size_t bufferFrames = 0;
+	// Next output frame: its newest input frame and filter phase
+	long long nextInput = 0;
+	int nextPhase = 0;
+	unsigned long long inputFrames = 0; // fed so far
+	unsigned long long outputFrames = 0; // produced so far
+
+	/** Prepares the conversion of interleaved frames of samplesPerFrame channels, fed at most
+	maxInputFrames at a time. Allocates; returns a negative error code of write_wav.h for unsupported rates.
+	*/
+	long init(int inputRate, int outputRate, int samplesPerFrame, size_t maxInputFrames);
+	/** Most frames process() can return for numFrames input frames. */
+	size_t maxOutput(size_t numFrames) const {
+		return (size_t) (((unsigned long long) numFrames * up + down - 1) / down) + 1;
+	}
+	/** Converts up to maxInput interleaved frames. Returns the number of frames written to out.
+	The last half filter length of output waits for more input, or for flush().
+	*/
+	size_t process(const float *in, size_t numFrames, float *out);
+	/** Writes the rest of the converted signal, up to maxOutput(maxInput) frames per call, until it
+	returns 0. The output then has as many frames as the input at the output rate, rounded up.
+	*/
+	size_t flush(float *out);
+	void filter(const float *frames, const float *phaseCoefs, float *out);
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+/** Lock-free ring buffer for exactly one producer thread and one consumer thread.
+
+The producer only ever stores `end` and the consumer only ever stores `start`. Both indices
+grow monotonically and are masked on access, so the capacity is always a power of 2.
+Elements are published with release/acquire ordering, which makes the data written by the
+producer visible to the consumer without any lock.
+
+The capacity is chosen at runtime, but the storage is only allocated by resize(), never by
+push() or by the consumer calls, so the buffer is safe to use from the audio thread.
+*/
+template <typename T>
+struct SPSCRingBuffer {
+	std::vector<T> data;
+	size_t capacity = 0;
+	std::atomic<size_t> start;
+	std::atomic<size_t> end;
+
+	SPSCRingBuffer(size_t minCapacity = 0) : start(0), end(0) {
+		resize(minCapacity);
+	}
+
+	/** Sets the capacity to the next power of 2 of `minCapacity` and drops the contents.
+	Neither the producer nor the consumer may use the buffer during the call.
+	*/
+	void resize(size_t minCapacity) {
+		size_t c = 1;
+		while (c < minCapacity)
+			c *= 2;
+		if (c != capacity) {
+			std::vector<T>(c).swap(data);
+			capacity = c;
+		}
+		start = 0;
+		end = 0;
+	}
+
+	size_t mask(size_t i) const {
+		return i & (capacity - 1);
+	}
+
+	/** Producer: appends an element. Returns false without blocking if the buffer is full. */
+	bool push(const T &t) {
+		size_t e = end.load(std::memory_order_relaxed);
+		if (e - start.load(std::memory_order_acquire) >= capacity)
+			return false;
+		data[mask(e)] = t;
+		end.store(e + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Consumer: finds the longest contiguous run of readable elements at the read index.
+	Sets `*first` to the first element and returns the run length. Call consume() when done
+	with the elements; a wrapped buffer needs a second call to reach the rest.
+	*/
+	size_t peek(T **first) {
+		size_t s = start.load(std::memory_order_relaxed);
+		size_t n = end.load(std::memory_order_acquire) - s;
+		size_t i = mask(s);
+		if (n > capacity - i)
+			n = capacity - i;
+		*first = &data[i];
+		return n;
+	}
+
+	/** Consumer: releases `n` elements back to the producer. */
+	void consume(size_t n) {
+		start.store(start.load(std::memory_order_relaxed) + n, std::memory_order_release);
+	}
+
+	/** Consumer: drops everything currently in the buffer. */
+	void clear() {
+		start.store(end.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+	size_t size() const {
+		return end.load(std::memory_order_acquire) - start.load(std::memory_order_acquire);
+	}
+	bool empty() const {
+		return size() == 0;
+	}
+	bool full() const {
+		return size() >= capacity;
+	}
+};
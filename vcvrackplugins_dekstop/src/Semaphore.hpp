@@ -0,0 +1,57 @@
+#pragma once
+
+#if defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <errno.h>
+#include <semaphore.h>
+#include <time.h>
+#endif
+
+/** Counting semaphore used to wake worker threads from the audio thread.
+
+post() never blocks and takes no lock, so it is safe to call from Module::step().
+wait() returns true when posted, false once `timeout` seconds have passed without a post.
+*/
+struct Semaphore {
+#if defined(__APPLE__)
+	dispatch_semaphore_t sem;
+	Semaphore() { sem = dispatch_semaphore_create(0); }
+	~Semaphore() { dispatch_release(sem); }
+	void post() { dispatch_semaphore_signal(sem); }
+	bool wait(float timeout) {
+		return dispatch_semaphore_wait(sem, dispatch_time(DISPATCH_TIME_NOW, (int64_t) (timeout * 1e9))) == 0;
+	}
+#elif defined(_WIN32)
+	HANDLE sem;
+	Semaphore() { sem = CreateSemaphore(NULL, 0, MAXLONG, NULL); }
+	~Semaphore() { CloseHandle(sem); }
+	void post() { ReleaseSemaphore(sem, 1, NULL); }
+	bool wait(float timeout) {
+		return WaitForSingleObject(sem, (DWORD) (timeout * 1000)) == WAIT_OBJECT_0;
+	}
+#else
+	sem_t sem;
+	Semaphore() { sem_init(&sem, 0, 0); }
+	~Semaphore() { sem_destroy(&sem); }
+	void post() { sem_post(&sem); }
+	bool wait(float timeout) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		long long ns = ts.tv_nsec + (long long) (timeout * 1e9);
+		ts.tv_sec += ns / 1000000000;
+		ts.tv_nsec = ns % 1000000000;
+		while (sem_timedwait(&sem, &ts) != 0) {
+			if (errno != EINTR)
+				return false;
+		}
+		return true;
+	}
+#endif
+};
@@ -13,4 +13,6 @@ void init(rack::Plugin *p) {
         p->addModel(modelGateSEQ8);
         p->addModel(modelRecorder2);
         p->addModel(modelRecorder8);
+        p->addModel(modelRecorder16);
+        p->addModel(modelRecorder32);
 }
@@ -6,7 +6,8 @@ extern Plugin *plugin;
 
 extern Model *modelTriSEQ3;
 extern Model *modelGateSEQ8;
-//extern Model *modelRecorder;
 extern Model *modelRecorder2;
 extern Model *modelRecorder8;
+extern Model *modelRecorder16;
+extern Model *modelRecorder32;
 